@@ -0,0 +1,127 @@
+#include "art.h"
+#include <stddef.h>
+
+// --- Version 1 shim ---
+// The instance state of a wrapped module is the version 1 table itself
+
+static void legacy_update(void *state, const ArtFrame *frame) {
+    const ArtModule *legacy = state;
+    if (legacy->update) legacy->update(frame->progress, frame->time);
+}
+
+static void legacy_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    const ArtModule *legacy = state;
+    if (legacy->draw) legacy->draw(buffer, frame->palette);
+}
+
+static void legacy_destroy(void *state) {
+    const ArtModule *legacy = state;
+    if (legacy->destroy) legacy->destroy();
+}
+
+static void legacy_handle_input(void *state, int key) {
+    const ArtModule *legacy = state;
+    if (legacy->handle_input) legacy->handle_input(key);
+}
+
+static void legacy_resize(void *state, int width, int height) {
+    const ArtModule *legacy = state;
+    legacy->resize(width, height);
+}
+
+static double legacy_next_change(void *state, double time_elapsed) {
+    const ArtModule *legacy = state;
+    return legacy->next_change(time_elapsed);
+}
+
+ArtModuleV2 art_module_wrap(const ArtModule *legacy) {
+    return (ArtModuleV2){
+        .name = legacy->name,
+        .description = legacy->description,
+        .update = legacy_update,
+        .draw = legacy_draw,
+        .destroy = legacy_destroy,
+        .handle_input = legacy_handle_input,
+        // Whether these are set changes what the loop does
+        .resize = legacy->resize ? legacy_resize : NULL,
+        .next_change = legacy->next_change ? legacy_next_change : NULL,
+        .legacy = legacy,
+    };
+}
+
+// --- Instances ---
+
+// Stands in for a module that failed to set up: it draws nothing
+static const ArtModuleV2 empty_module = {.name = "empty"};
+
+int art_instance_create(ArtInstance *instance, const ArtModuleV2 *module,
+                        int width, int height, ColorPalette *palette) {
+    instance->module = module;
+    instance->state = NULL;
+    instance->frame = (ArtFrame){.width = width, .height = height, .palette = palette};
+    instance->updated = 0;
+
+    if (module->legacy) {
+        if (module->legacy->init) module->legacy->init(width, height, palette);
+        instance->state = (void *)module->legacy;
+    } else if (module->create) {
+        instance->state = module->create(width, height, palette);
+        if (!instance->state) {
+            instance->module = &empty_module;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void art_instance_destroy(ArtInstance *instance) {
+    if (instance->module && instance->module->destroy) {
+        instance->module->destroy(instance->state);
+    }
+    instance->module = NULL;
+    instance->state = NULL;
+}
+
+void art_instance_update(ArtInstance *instance, double progress, double time) {
+    ArtFrame *frame = &instance->frame;
+    frame->dt = instance->updated ? time - frame->time : 0;
+    frame->progress = progress;
+    frame->time = time;
+    instance->updated = 1;
+    if (instance->module->update) instance->module->update(instance->state, frame);
+}
+
+void art_instance_draw(ArtInstance *instance, ScreenBuffer *buffer, ColorPalette *palette) {
+    ArtFrame frame = instance->frame;
+    frame.width = buffer->width;
+    frame.height = buffer->height;
+    frame.palette = palette;
+    if (instance->module->draw) instance->module->draw(instance->state, buffer, &frame);
+}
+
+void art_instance_handle_input(ArtInstance *instance, int key) {
+    if (instance->module->handle_input) instance->module->handle_input(instance->state, key);
+}
+
+void art_instance_resize(ArtInstance *instance, int width, int height, ColorPalette *palette) {
+    const ArtModuleV2 *module = instance->module;
+    if (module->resize) {
+        module->resize(instance->state, width, height);
+        instance->frame.width = width;
+        instance->frame.height = height;
+        return;
+    }
+    // Start over at the new size, keeping the slide clock
+    ArtFrame frame = instance->frame;
+    int updated = instance->updated;
+    art_instance_destroy(instance);
+    if (!art_instance_create(instance, module, width, height, palette)) return;
+    instance->frame.progress = frame.progress;
+    instance->frame.time = frame.time;
+    instance->updated = updated;
+}
+
+double art_instance_next_change(ArtInstance *instance, double time_elapsed) {
+    if (!instance->module->next_change) return -1;
+    return instance->module->next_change(instance->state, time_elapsed);
+}
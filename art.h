@@ -4,6 +4,17 @@
 #include "buffer.h"
 #include "config.h"
 
+// Called by parallel_for_rows for one row of the buffer
+typedef void (*RowFn)(ScreenBuffer *buffer, int row, void *ctx);
+
+// Run fn for every row of the buffer on the worker pool. Rows are handed out
+// one at a time, so expensive rows do not hold up the rest. fn must only
+// draw into its own row.
+void parallel_for_rows(ScreenBuffer *buffer, RowFn fn, void *ctx);
+
+// Returned by next_change() when only input can change the picture
+#define NEXT_CHANGE_NEVER INFINITY
+
 // The interface for any art module
 typedef struct {
     const char *name;
@@ -18,6 +29,83 @@ typedef struct {
     void (*destroy)();
     // Called on key press for module-specific interaction
     void (*handle_input)(int key);
+    // Called when the screen size changes; keeps the module's state.
+    // Modules without it are destroyed and re-initialized instead.
+    void (*resize)(int width, int height);
+    // Given the slide time of the frame just drawn, returns the slide time
+    // (seconds) at which the picture next changes, or NEXT_CHANGE_NEVER.
+    // The loop sleeps until then. Modules without it are redrawn every frame.
+    double (*next_change)(double time_elapsed);
 } ArtModule;
 
+// What a module is told about the frame it updates or draws
+typedef struct {
+    int width, height;     // Screen size in cells
+    double progress;       // How far through the slide (0 to 1)
+    double time;           // Seconds since the slide started
+    double dt;             // Seconds since the previous update (0 for the first)
+    ColorPalette *palette;
+} ArtFrame;
+
+// Version 2 of the module interface. Each instance keeps its state behind
+// the pointer create() returns instead of in file-scope statics, and draws
+// only into the buffer it is given, so several instances can exist at once
+// and they can be drawn off the main thread. Every callback may be NULL.
+typedef struct {
+    const char *name;
+    const char *description;
+    // Set up a new instance and return its state, or NULL on failure.
+    // Modules without state leave it out.
+    void *(*create)(int width, int height, ColorPalette *palette);
+    // Advance the animation to frame->time
+    void (*update)(void *state, const ArtFrame *frame);
+    // Draw the state into buffer; frame is the one last passed to update()
+    void (*draw)(void *state, ScreenBuffer *buffer, const ArtFrame *frame);
+    // Free the state
+    void (*destroy)(void *state);
+    // Module-specific keys
+    void (*handle_input)(void *state, int key);
+    // The screen size changed; keep the state. Without it the instance is
+    // destroyed and created again.
+    void (*resize)(void *state, int width, int height);
+    // As ArtModule.next_change
+    double (*next_change)(void *state, double time_elapsed);
+    // Set by art_module_wrap(): the version 1 module behind this one
+    const ArtModule *legacy;
+} ArtModuleV2;
+
+// A running module
+typedef struct {
+    const ArtModuleV2 *module;
+    void *state;
+    ArtFrame frame;  // What the last update() saw
+    int updated;     // Whether update() has run yet (for dt)
+} ArtInstance;
+
+// Run a version 1 module through the version 2 interface. Its state is
+// still global, so only one instance of it may exist at a time. legacy
+// must outlive the returned module.
+ArtModuleV2 art_module_wrap(const ArtModule *legacy);
+
+// Create an instance of module for a width x height screen. Returns 0 if
+// the module failed to set up; the instance then draws nothing.
+int art_instance_create(ArtInstance *instance, const ArtModuleV2 *module,
+                        int width, int height, ColorPalette *palette);
+void art_instance_destroy(ArtInstance *instance);
+
+// Advance the instance to the given slide time
+void art_instance_update(ArtInstance *instance, double progress, double time);
+
+// Draw the instance into buffer
+void art_instance_draw(ArtInstance *instance, ScreenBuffer *buffer, ColorPalette *palette);
+
+void art_instance_handle_input(ArtInstance *instance, int key);
+
+// Resize the instance, re-creating it if the module cannot resize in place
+void art_instance_resize(ArtInstance *instance, int width, int height, ColorPalette *palette);
+
+// Slide time of the next change (see ArtModule.next_change), or -1 when
+// the module does not say and has to be redrawn every frame
+double art_instance_next_change(ArtInstance *instance, double time_elapsed);
+
 #endif // ART_H
\ No newline at end of file
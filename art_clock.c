@@ -4,7 +4,9 @@
 
 const float PI = 3.1415926535f;
 
-void clock_draw(ScreenBuffer *buffer, ColorPalette* palette) {
+void clock_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    (void)state;
+    ColorPalette *palette = frame->palette;
     int center_x = buffer->width / 2;
     int center_y = buffer->height / 2;
     int radius = (buffer->height < buffer->width/2 ? buffer->height : buffer->width/2) / 2 - 2;
@@ -15,7 +17,7 @@ void clock_draw(ScreenBuffer *buffer, ColorPalette* palette) {
         float angle = (float)i / 12.0f * 2.0f * PI;
         int x = center_x + (int)(sinf(angle) * radius * 2); // *2 for aspect ratio
         int y = center_y - (int)(cosf(angle) * radius);
-        buffer_draw_char(x, y, 'o', palette->colors[0], (Color){0,0,0});
+        buffer_set_char(buffer, x, y, 'o', palette->colors[0], (Color){0,0,0});
     }
 
     // Get time
@@ -26,33 +28,39 @@ void clock_draw(ScreenBuffer *buffer, ColorPalette* palette) {
 
     // Hour hand
     float hour_angle = (time_info->tm_hour % 12 + time_info->tm_min / 60.0f) / 12.0f * 2.0f * PI;
-    buffer_draw_line(center_x, center_y,
+    buffer_set_line(buffer, center_x, center_y,
               center_x + (int)(sinf(hour_angle) * radius * 1.0),
               center_y - (int)(cosf(hour_angle) * radius * 0.5),
               '#', palette->colors[1]);
 
     // Minute hand
     float min_angle = (time_info->tm_min + time_info->tm_sec / 60.0f) / 60.0f * 2.0f * PI;
-    buffer_draw_line(center_x, center_y,
+    buffer_set_line(buffer, center_x, center_y,
               center_x + (int)(sinf(min_angle) * radius * 1.8),
               center_y - (int)(cosf(min_angle) * radius * 0.9),
               '+', palette->colors[2]);
 
     // Second hand
     float sec_angle = time_info->tm_sec / 60.0f * 2.0f * PI;
-    buffer_draw_line(center_x, center_y,
+    buffer_set_line(buffer, center_x, center_y,
               center_x + (int)(sinf(sec_angle) * radius * 1.9),
               center_y - (int)(cosf(sec_angle) * radius * 0.95),
               '.', palette->colors[3]);
 }
 
-ArtModule get_clock_module() {
-    return (ArtModule){
+double clock_next_change(void *state, double time_elapsed) {
+    (void)state;
+    // The hands move when the wall clock reaches the next second
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return time_elapsed + (1000000000L - now.tv_nsec) / 1e9;
+}
+
+ArtModuleV2 get_clock_module() {
+    return (ArtModuleV2){
         .name = "clock",
         .description = "An analog-style ASCII clock showing system time",
-        .init = NULL,
-        .update = NULL,
         .draw = clock_draw,
-        .destroy = NULL,
+        .next_change = clock_next_change,
     };
 }
@@ -3,25 +3,38 @@
 #include <stdlib.h> // For abs()
 
 typedef struct { float x, y, z; } Point3D;
-static Point3D points[8];
-static float angle_x = 0, angle_y = 0;
 
-void cube_init(int width, int height, ColorPalette* palette) {
-    (void)width; (void)height;
+typedef struct {
+    Point3D points[8];
+    float angle_x, angle_y;
+} CubeState;
+
+void *cube_create(int width, int height, ColorPalette* palette) {
+    (void)width; (void)height; (void)palette;
+    CubeState *cube = calloc(1, sizeof(CubeState));
+    if (!cube) return NULL;
     int i = 0;
     for (int x = -1; x <= 1; x += 2)
         for (int y = -1; y <= 1; y += 2)
             for (int z = -1; z <= 1; z += 2)
-                points[i++] = (Point3D){(float)x, (float)y, (float)z};
+                cube->points[i++] = (Point3D){(float)x, (float)y, (float)z};
+    return cube;
+}
+
+void cube_destroy(void *state) {
+    free(state);
 }
 
-void cube_update(double progress, double time_elapsed) {
-    (void)progress;
-    angle_x = time_elapsed * 0.5f;
-    angle_y = time_elapsed * 0.3f;
+void cube_update(void *state, const ArtFrame *frame) {
+    CubeState *cube = state;
+    cube->angle_x = frame->time * 0.5f;
+    cube->angle_y = frame->time * 0.3f;
 }
 
-void cube_draw(ScreenBuffer *buffer, ColorPalette* palette) {
+void cube_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    const CubeState *cube = state;
+    const Point3D *points = cube->points;
+    float angle_x = cube->angle_x, angle_y = cube->angle_y;
     Point3D transformed[8];
     for (int i = 0; i < 8; i++) {
         // Rotate Y
@@ -41,26 +54,26 @@ void cube_draw(ScreenBuffer *buffer, ColorPalette* palette) {
         projected[i][1] = (int)(transformed[i].y / z * buffer->height * 0.5 + buffer->height / 2);
     }
 
-    Color c = palette->colors[0];
+    Color c = frame->palette->colors[0];
     for (int i = 0; i < 4; i++) {
         // Draw lines connecting the front and back faces of the cube
-        buffer_draw_line(projected[i][0], projected[i][1], projected[i+4][0], projected[i+4][1], '#', c);
+        buffer_set_line(buffer, projected[i][0], projected[i][1], projected[i+4][0], projected[i+4][1], '#', c);
         // Draw the front face
-        buffer_draw_line(projected[i][0], projected[i][1], projected[(i&2)?i-2:i+2][0], projected[(i&2)?i-2:i+2][1], '#', c);
-        buffer_draw_line(projected[i][0], projected[i][1], projected[(i&1)?i-1:i+1][0], projected[(i&1)?i-1:i+1][1], '#', c);
+        buffer_set_line(buffer, projected[i][0], projected[i][1], projected[(i&2)?i-2:i+2][0], projected[(i&2)?i-2:i+2][1], '#', c);
+        buffer_set_line(buffer, projected[i][0], projected[i][1], projected[(i&1)?i-1:i+1][0], projected[(i&1)?i-1:i+1][1], '#', c);
         // Draw the back face
-        buffer_draw_line(projected[i+4][0], projected[i+4][1], projected[(i&2)?i+2:i+6][0], projected[(i&2)?i+2:i+6][1], '#', c);
-        buffer_draw_line(projected[i+4][0], projected[i+4][1], projected[(i&1)?i+3:i+5][0], projected[(i&1)?i+3:i+5][1], '#', c);
+        buffer_set_line(buffer, projected[i+4][0], projected[i+4][1], projected[(i&2)?i+2:i+6][0], projected[(i&2)?i+2:i+6][1], '#', c);
+        buffer_set_line(buffer, projected[i+4][0], projected[i+4][1], projected[(i&1)?i+3:i+5][0], projected[(i&1)?i+3:i+5][1], '#', c);
     }
 }
 
-ArtModule get_cube_module() {
-    return (ArtModule){
+ArtModuleV2 get_cube_module() {
+    return (ArtModuleV2){
         .name = "cube",
         .description = "A rotating 3D wireframe cube",
-        .init = cube_init,
+        .create = cube_create,
         .update = cube_update,
         .draw = cube_draw,
-        .destroy = NULL,
+        .destroy = cube_destroy,
     };
 }
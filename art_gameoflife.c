@@ -2,26 +2,71 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int *world;
-static int *next_world;
+typedef struct {
+    int *world;
+    int *next_world;
+    int world_width, world_height;
+} LifeState;
 
-void gol_init(int width, int height, ColorPalette* palette) {
-    world = malloc(width * height * sizeof(int));
-    next_world = malloc(width * height * sizeof(int));
+void gol_destroy(void *state) {
+    LifeState *life = state;
+    free(life->world);
+    free(life->next_world);
+    free(life);
+}
+
+void *gol_create(int width, int height, ColorPalette* palette) {
+    (void)palette;
+    LifeState *life = calloc(1, sizeof(LifeState));
+    if (!life) return NULL;
+    life->world_width = width;
+    life->world_height = height;
+    life->world = malloc(width * height * sizeof(int));
+    life->next_world = malloc(width * height * sizeof(int));
+    if (!life->world || !life->next_world) {
+        gol_destroy(life);
+        return NULL;
+    }
     for (int i = 0; i < width * height; i++) {
-        world[i] = (rand() % 4 == 0); // 25% chance of being alive
+        life->world[i] = (rand() % 4 == 0); // 25% chance of being alive
     }
+    return life;
 }
 
-void gol_destroy() {
-    free(world);
-    free(next_world);
+// Resample the world onto the new grid so the colony survives a resize
+void gol_resize(void *state, int width, int height) {
+    LifeState *life = state;
+    int *world = life->world;
+    int world_width = life->world_width, world_height = life->world_height;
+    int *resized = malloc(width * height * sizeof(int));
+    int *resized_next = malloc(width * height * sizeof(int));
+    if (!resized || !resized_next) {
+        free(resized);
+        free(resized_next);
+        return;
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int old_x = x * world_width / width;
+            int old_y = y * world_height / height;
+            resized[y * width + x] = world[old_y * world_width + old_x];
+        }
+    }
+    free(life->world);
+    free(life->next_world);
+    life->world = resized;
+    life->next_world = resized_next;
+    life->world_width = width;
+    life->world_height = height;
 }
 
-void gol_update(double progress, double time_elapsed) {
-    (void)progress; (void)time_elapsed;
-    int width = get_buffer()->width;
-    int height = get_buffer()->height;
+void gol_update(void *state, const ArtFrame *frame) {
+    (void)frame;
+    LifeState *life = state;
+    int *world = life->world;
+    int *next_world = life->next_world;
+    int width = life->world_width;
+    int height = life->world_height;
 
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
@@ -47,21 +92,24 @@ void gol_update(double progress, double time_elapsed) {
     memcpy(world, next_world, width * height * sizeof(int));
 }
 
-void gol_draw(ScreenBuffer *buffer, ColorPalette* palette) {
-    for (int i = 0; i < buffer->width * buffer->height; i++) {
-        if (world[i]) {
-            buffer_draw_char(i % buffer->width, i / buffer->width, '#', palette->colors[0], (Color){0,0,0});
+void gol_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    const LifeState *life = state;
+    for (int i = 0; i < life->world_width * life->world_height; i++) {
+        if (life->world[i]) {
+            buffer_set_char(buffer, i % life->world_width, i / life->world_width, '#',
+                            frame->palette->colors[0], (Color){0,0,0});
         }
     }
 }
 
-ArtModule get_gameoflife_module() {
-    return (ArtModule){
+ArtModuleV2 get_gameoflife_module() {
+    return (ArtModuleV2){
         .name = "game-of-life",
         .description = "Conway's Game of Life cellular automaton",
-        .init = gol_init,
+        .create = gol_create,
         .update = gol_update,
         .draw = gol_draw,
         .destroy = gol_destroy,
+        .resize = gol_resize,
     };
 }
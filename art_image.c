@@ -41,6 +41,7 @@ void image_draw(ScreenBuffer *buffer, ColorPalette* palette) {
 
     if (pid == 0) {
         // Child process
+        term_unblock_signals();
         execlp("img2sixel", "img2sixel", image_path, NULL);
         // If execlp returns, it must have failed
         perror("execlp");
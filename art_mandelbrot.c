@@ -1,82 +1,437 @@
 #include "art.h"
+#include "art_mandelbrot_deep.h"
+#include "art_mandelbrot_kernel.h"
 #include "terminal.h"
+#include "threadpool.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
-static double current_re = -0.5, current_im = 0.0, range = 4.0;
+typedef struct {
+    // Once deep, the center is kept relative to the anchor, which holds
+    // the digits a double cannot
+    double current_re, current_im, range;
+    DeepFixed anchor_re, anchor_im;
+    int anchored;
+    // The reference orbit deep views are drawn against, taken at the anchor
+    MandelbrotDeep deep;
+    int deep_valid;
+    int width, height;  // Screen size the pan steps are worked out for
+    // Whole cells the view has panned since the field was drawn
+    int pan_x, pan_y;
+    // Escape values of the last view drawn, one per cell, so a view that
+    // has not moved only needs coloring again
+    float *field;
+    size_t field_capacity;
+    MandelbrotView field_view;
+    // Cells between the samples of the field worked out so far: 1 once it
+    // is complete, 0 before the first draw
+    int field_step;
+    // Work out new views by Mariani-Silver subdivision instead
+    int subdivide;
+} MandelbrotState;
 
-void mandelbrot_handle_input(int key) {
+// What the rows drawn on the worker pool need
+typedef struct {
+    const MandelbrotView *view;
+    float *field;
+    Rect kept;          // Cells whose escape values carried over from the last draw
+    int step;           // Cells between the samples this pass works out
+    int previous;       // Cells between those of the pass before, or 0
+    ColorPalette *palette;
+} MandelbrotJob;
+
+// Cells the kernel works out at a time; the scratch row lives on the stack
+#define SPAN 256
+// A new view is first drawn from one sample per 8x8 cells, then refined
+// over the next frames to 4x4, 2x2 and every cell
+#define COARSEST_STEP 8
+// Mariani-Silver works on tiles of this many cells, shared out among the
+// threads, and splits rectangles until they are this narrow
+#define TILE_WIDTH 64
+#define TILE_HEIGHT 32
+#define SUBDIVIDE_MIN 4
+// The palette repeats every tenth of this many iterations, however deep
+// the view and its max_iter
+#define COLOR_CYCLE 256
+
+void *mandelbrot_create(int width, int height, ColorPalette *palette) {
+    (void)palette;
+    MandelbrotState *state = calloc(1, sizeof(MandelbrotState));
+    if (!state) return NULL;
+    state->current_re = -0.5;
+    state->current_im = 0.0;
+    state->range = 4.0;
+    state->width = width > 0 ? width : 1;
+    state->height = height;
+    return state;
+}
+
+void mandelbrot_destroy(void *state) {
+    MandelbrotState *view = state;
+    free(view->field);
+    mandelbrot_deep_free(&view->deep);
+    free(view);
+}
+
+// Keep the view (center, zoom, deep zoom anchor, mode) and work out the
+// new screen from scratch
+void mandelbrot_resize(void *state, int width, int height) {
+    MandelbrotState *view = state;
+    view->width = width > 0 ? width : 1;
+    view->height = height;
+    view->field_step = 0;
+    view->pan_x = view->pan_y = 0;
+}
+
+// Move the view by whole cells, so the escape values already worked out
+// only need shifting
+static void pan(MandelbrotState *view, int dx, int dy) {
+    double spacing = view->range / view->width;
+    view->current_re += dx * spacing;
+    view->current_im += dy * spacing * 0.5;
+    view->pan_x += dx;
+    view->pan_y += dy;
+}
+
+void mandelbrot_handle_input(void *state, int key) {
+    MandelbrotState *view = state;
+    // A step is a tenth of the range, rounded to cells; cells are twice as
+    // tall as wide
+    int step_x = (int)lround(view->width * 0.1), step_y = (int)lround(view->width * 0.2);
+    if (step_x < 1) step_x = 1;
+    if (step_y < 1) step_y = 1;
     switch (key) {
         case 'w':
-            current_im -= range * 0.1;
+            pan(view, 0, -step_y);
             break;
         case 's':
-            current_im += range * 0.1;
+            pan(view, 0, step_y);
             break;
         case 'a':
-            current_re -= range * 0.1;
+            pan(view, -step_x, 0);
             break;
         case 'd':
-            current_re += range * 0.1;
+            pan(view, step_x, 0);
             break;
         case '=': // Zoom in
         case '+':
-            range *= 0.9;
+            if (view->range * 0.9 >= MANDELBROT_MIN_RANGE) view->range *= 0.9;
             break;
         case '-': // Zoom out
-            range *= 1.1;
+            view->range *= 1.1;
+            break;
+        case 'm': // Mariani-Silver subdivision on or off
+            view->subdivide = !view->subdivide;
             break;
     }
 }
 
-void mandelbrot_update(double progress, double time_elapsed) {
-    (void)progress; (void)time_elapsed; // No-op
-}
-
-void mandelbrot_draw(ScreenBuffer *buffer, ColorPalette* palette) {
-    int max_iter = 256; // Increased for more detail
-    for (int row = 0; row < buffer->height; row++) {
-        for (int col = 0; col < buffer->width; col++) {
-            // Map pixel to the complex plane, adjusting for aspect ratio
-            double c_re = current_re + (col - buffer->width / 2.0) * range / buffer->width;
-            double c_im = current_im + (row - buffer->height / 2.0) * range / buffer->width * 0.5;
-
-            double x = 0, y = 0;
-            int iteration = 0;
-            // Use a larger escape radius for the smooth coloring algorithm
-            while (x * x + y * y <= (1 << 16) && iteration < max_iter) {
-                double x_new = x * x - y * y + c_re;
-                y = 2 * x * y + c_im;
-                x = x_new;
-                iteration++;
-            }
-
-            if (iteration < max_iter) {
-                // Smooth coloring algorithm
-                double log_zn = log(x * x + y * y) / 2.0;
-                double nu = log(log_zn / log(2.0)) / log(2.0);
-                
-                // Scale the smooth iteration value to the palette
-                float t = (float)(iteration + 1.0 - nu) / (float)max_iter;
-
-                // Cycle through the palette multiple times for more color variation
-                Color c = get_palette_color(palette, fmodf(t * 10.0f, 1.0f));
-                buffer_draw_char(col, row, '#', c, (Color){0,0,0});
-            } else {
-                // Points inside the set are black
-                buffer_draw_char(col, row, ' ', (Color){0,0,0}, (Color){0,0,0});
-            }
+// Work out the cells x0, x0 + stride, ... of a row of the field
+static void sample_row(const MandelbrotView *view, int row, int x0, int stride, float *escape) {
+    if (x0 >= view->width) return;
+    int count = (view->width - x0 + stride - 1) / stride;
+    if (stride == 1) {
+        mandelbrot_kernel_row(view, row, x0, 1, count, escape + x0);
+        return;
+    }
+    float samples[SPAN];
+    for (int i = 0; i < count; i += SPAN) {
+        int n = count - i < SPAN ? count - i : SPAN;
+        int x = x0 + i * stride;
+        mandelbrot_kernel_row(view, row, x, stride, n, samples);
+        for (int j = 0; j < n; j++) escape[x + j * stride] = samples[j];
+    }
+}
+
+// Work out the escape values the job needs on a row
+static void mandelbrot_sample_row(ScreenBuffer *buffer, int row, void *ctx) {
+    const MandelbrotJob *job = ctx;
+    const Rect *kept = &job->kept;
+    int step = job->step;
+    float *escape = job->field + (size_t)row * buffer->width;
+    if (row % step != 0) {
+        // Shown from the samples of the row above
+    } else if (job->previous && row % job->previous == 0) {
+        // The pass before worked out every other sample of this row
+        sample_row(job->view, row, step, job->previous, escape);
+    } else if (row < kept->y || row >= kept->y + kept->height) {
+        sample_row(job->view, row, 0, step, escape);
+    } else {
+        // Only the columns the pan uncovered
+        int kept_end = kept->x + kept->width;
+        if (kept->x > 0) mandelbrot_kernel_row(job->view, row, 0, 1, kept->x, escape);
+        if (kept_end < buffer->width) {
+            mandelbrot_kernel_row(job->view, row, kept_end, 1, buffer->width - kept_end, escape + kept_end);
+        }
+    }
+}
+
+static void mandelbrot_color_row(ScreenBuffer *buffer, int row, void *ctx) {
+    const MandelbrotJob *job = ctx;
+    int step = job->step;
+    // Until the field is complete, each cell shows the sample at the
+    // corner of its block
+    const float *samples = job->field + (size_t)(row - row % step) * buffer->width;
+    for (int block = 0; block < buffer->width; block += step) {
+        float value = samples[block];
+        char glyph = ' ';
+        Color c = {0, 0, 0}; // Points inside the set are black
+        if (value >= 0) {
+            // Scale the smooth iteration value to the palette
+            float t = value / (float)COLOR_CYCLE;
+
+            // Cycle through the palette multiple times for more color variation
+            c = get_palette_color(job->palette, fmodf(t * 10.0f, 1.0f));
+            glyph = '#';
+        }
+        int end = block + step < buffer->width ? block + step : buffer->width;
+        for (int col = block; col < end; col++) {
+            buffer_set_char(buffer, col, row, glyph, c, (Color){0,0,0});
+        }
+    }
+}
+
+// --- Mariani-Silver subdivision ---
+//
+// The set is connected, so when every cell on a rectangle's border has the
+// same escape value (in practice: all inside the set) so does every cell
+// within. Rectangles that pass are filled without iterating; the rest are
+// split in two, sharing the dividing line, until they are small.
+
+static void sample_column(const MandelbrotView *view, float *field, int x, int y0, int y1) {
+    float samples[SPAN];
+    for (int y = y0; y < y1; y += SPAN) {
+        int n = y1 - y < SPAN ? y1 - y : SPAN;
+        mandelbrot_kernel_column(view, x, y, n, samples);
+        for (int i = 0; i < n; i++) field[(size_t)(y + i) * view->width + x] = samples[i];
+    }
+}
+
+static void sample_border(const MandelbrotView *view, float *field, Rect r) {
+    int right = r.x + r.width - 1, bottom = r.y + r.height - 1;
+    mandelbrot_kernel_row(view, r.y, r.x, 1, r.width, field + (size_t)r.y * view->width + r.x);
+    if (bottom > r.y) {
+        mandelbrot_kernel_row(view, bottom, r.x, 1, r.width, field + (size_t)bottom * view->width + r.x);
+    }
+    sample_column(view, field, r.x, r.y + 1, bottom);
+    if (right > r.x) sample_column(view, field, right, r.y + 1, bottom);
+}
+
+static int border_uniform(const MandelbrotView *view, const float *field, Rect r) {
+    const float *top = field + (size_t)r.y * view->width;
+    const float *bottom = field + (size_t)(r.y + r.height - 1) * view->width;
+    float value = top[r.x];
+    for (int x = r.x; x < r.x + r.width; x++) {
+        if (top[x] != value || bottom[x] != value) return 0;
+    }
+    for (int y = r.y + 1; y < r.y + r.height - 1; y++) {
+        const float *row = field + (size_t)y * view->width;
+        if (row[r.x] != value || row[r.x + r.width - 1] != value) return 0;
+    }
+    return 1;
+}
+
+// The border of r is worked out; do the inside
+static void subdivide(const MandelbrotView *view, float *field, Rect r) {
+    Rect inside = {r.x + 1, r.y + 1, r.width - 2, r.height - 2};
+    if (inside.width <= 0 || inside.height <= 0) return;
+
+    if (border_uniform(view, field, r)) {
+        float value = field[(size_t)r.y * view->width + r.x];
+        for (int y = inside.y; y < inside.y + inside.height; y++) {
+            float *row = field + (size_t)y * view->width;
+            for (int x = inside.x; x < inside.x + inside.width; x++) row[x] = value;
+        }
+    } else if (inside.width < SUBDIVIDE_MIN || inside.height < SUBDIVIDE_MIN) {
+        for (int y = inside.y; y < inside.y + inside.height; y++) {
+            mandelbrot_kernel_row(view, y, inside.x, 1, inside.width, field + (size_t)y * view->width + inside.x);
         }
+    } else if (r.width >= r.height) {
+        int mid = r.x + r.width / 2;
+        sample_column(view, field, mid, inside.y, inside.y + inside.height);
+        subdivide(view, field, (Rect){r.x, r.y, mid - r.x + 1, r.height});
+        subdivide(view, field, (Rect){mid, r.y, r.x + r.width - mid, r.height});
+    } else {
+        int mid = r.y + r.height / 2;
+        mandelbrot_kernel_row(view, mid, inside.x, 1, inside.width, field + (size_t)mid * view->width + inside.x);
+        subdivide(view, field, (Rect){r.x, r.y, r.width, mid - r.y + 1});
+        subdivide(view, field, (Rect){r.x, mid, r.width, r.y + r.height - mid});
+    }
+}
+
+typedef struct {
+    const MandelbrotView *view;
+    float *field;
+    int tiles_across;
+} SubdivideJob;
+
+static void subdivide_tiles(void *ctx, int begin, int end) {
+    const SubdivideJob *job = ctx;
+    const MandelbrotView *view = job->view;
+    for (int tile = begin; tile < end; tile++) {
+        Rect r = {
+            .x = tile % job->tiles_across * TILE_WIDTH,
+            .y = tile / job->tiles_across * TILE_HEIGHT,
+        };
+        r.width = view->width - r.x < TILE_WIDTH ? view->width - r.x : TILE_WIDTH;
+        r.height = view->height - r.y < TILE_HEIGHT ? view->height - r.y : TILE_HEIGHT;
+        sample_border(view, job->field, r);
+        subdivide(view, job->field, r);
+    }
+}
+
+// Work out the whole field of a view at once
+static void subdivide_field(const MandelbrotView *view, float *field) {
+    int tiles_across = (view->width + TILE_WIDTH - 1) / TILE_WIDTH;
+    int tiles_down = (view->height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    SubdivideJob job = {view, field, tiles_across};
+    parallel_for(tiles_across * tiles_down, 1, subdivide_tiles, &job);
+}
+
+static int same_view(const MandelbrotView *a, const MandelbrotView *b) {
+    return a->center_re == b->center_re && a->center_im == b->center_im && a->range == b->range &&
+           a->width == b->width && a->height == b->height && a->max_iter == b->max_iter && a->deep == b->deep;
+}
+
+// Move the field's escape values to where they land after panning by
+// (dx, dy) cells, and return the cells they cover
+static Rect shift_field(float *field, int width, int height, int dx, int dy) {
+    Rect kept = {
+        .x = dx < 0 ? -dx : 0,
+        .y = dy < 0 ? -dy : 0,
+        .width = width - abs(dx),
+        .height = height - abs(dy),
+    };
+    if (kept.width <= 0 || kept.height <= 0) return (Rect){0, 0, 0, 0};
+    // Walk the rows in the order that never overwrites one still to be moved
+    for (int i = 0; i < kept.height; i++) {
+        int y = dy > 0 ? kept.y + i : kept.y + kept.height - 1 - i;
+        memmove(field + (size_t)y * width + kept.x,
+                field + (size_t)(y + dy) * width + kept.x + dx,
+                kept.width * sizeof(float));
+    }
+    return kept;
+}
+
+// A deep view is drawn against a reference orbit at the anchor. Take a new
+// one when the orbit is too short for the zoom or the view has wandered
+// far from it, and drop the anchor once the view is shallow again.
+// Returns 0 when out of memory.
+static int prepare_deep(MandelbrotState *mandelbrot, int width, int height, int max_iter) {
+    double center_re = mandelbrot->current_re, center_im = mandelbrot->current_im;
+    if (mandelbrot->anchored) {
+        center_re += deep_fixed_to_double(&mandelbrot->anchor_re);
+        center_im += deep_fixed_to_double(&mandelbrot->anchor_im);
     }
+    double range = mandelbrot->range;
+    if (!mandelbrot_deep_needed(center_re, center_im, range, width)) {
+        if (mandelbrot->anchored) {
+            mandelbrot->current_re = center_re;
+            mandelbrot->current_im = center_im;
+            memset(&mandelbrot->anchor_re, 0, sizeof(DeepFixed));
+            memset(&mandelbrot->anchor_im, 0, sizeof(DeepFixed));
+            mandelbrot->anchored = 0;
+        }
+        mandelbrot->deep_valid = 0;
+        return 1;
+    }
+
+    MandelbrotDeep *deep = &mandelbrot->deep;
+    if (!mandelbrot->deep_valid || deep->max_iter < max_iter || fabs(mandelbrot->current_re) > 16 * range ||
+        fabs(mandelbrot->current_im) > 16 * range) {
+        deep_fixed_add_double(&mandelbrot->anchor_re, mandelbrot->current_re);
+        deep_fixed_add_double(&mandelbrot->anchor_im, mandelbrot->current_im);
+        mandelbrot->current_re = mandelbrot->current_im = 0;
+        mandelbrot->anchored = 1;
+        // Some headroom, so zooming in a little does not take a new orbit
+        mandelbrot->deep_valid = mandelbrot_deep_set_reference(deep, &mandelbrot->anchor_re, &mandelbrot->anchor_im,
+                                                               max_iter + max_iter / 4);
+        if (!mandelbrot->deep_valid) return 0;
+    }
+    double dc_re = fabs(mandelbrot->current_re) + range / 2;
+    double dc_im = fabs(mandelbrot->current_im) + range * height / width / 4;
+    mandelbrot_deep_set_extent(deep, hypot(dc_re, dc_im));
+    return 1;
+}
+
+void mandelbrot_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    MandelbrotState *mandelbrot = state;
+    int max_iter = mandelbrot_max_iter(mandelbrot->range);
+    if (!prepare_deep(mandelbrot, buffer->width, buffer->height, max_iter)) return;
+    MandelbrotView view = {
+        .center_re = mandelbrot->current_re,
+        .center_im = mandelbrot->current_im,
+        .range = mandelbrot->range,
+        .width = buffer->width,
+        .height = buffer->height,
+        .max_iter = max_iter,
+        .deep = mandelbrot->deep_valid ? &mandelbrot->deep : NULL,
+    };
+
+    size_t cells = (size_t)buffer->width * buffer->height;
+    if (cells > mandelbrot->field_capacity) {
+        float *field = realloc(mandelbrot->field, cells * sizeof(float));
+        if (!field) return;
+        mandelbrot->field = field;
+        mandelbrot->field_capacity = cells;
+        mandelbrot->field_step = 0;
+    }
+
+    // Carry on refining the view, or start on a new one. A view that moved
+    // drops whatever passes the old one still had to go.
+    MandelbrotJob job = {&view, mandelbrot->field, {0, 0, 0, 0}, COARSEST_STEP, 0, frame->palette};
+    int field_step = mandelbrot->field_step;
+    MandelbrotView panned = mandelbrot->field_view;
+    panned.center_re = view.center_re;
+    panned.center_im = view.center_im;
+    if (field_step && same_view(&view, &mandelbrot->field_view)) {
+        job.step = field_step > 1 ? field_step / 2 : 1;
+        job.previous = field_step > 1 ? field_step : 0;
+        if (field_step == 1) job.kept = (Rect){0, 0, view.width, view.height};
+    } else if (field_step == 1 && same_view(&view, &panned)) {
+        Rect kept = shift_field(mandelbrot->field, view.width, view.height, mandelbrot->pan_x, mandelbrot->pan_y);
+        if (kept.width > 0) {
+            // The uncovered strip is small enough to do in full at once
+            job.step = 1;
+            job.kept = kept;
+        }
+    }
+    if (job.step == COARSEST_STEP && mandelbrot->subdivide) {
+        // Subdivision needs whole rectangles, so it skips the coarse passes
+        subdivide_field(&view, mandelbrot->field);
+        job.step = 1;
+        job.kept = (Rect){0, 0, view.width, view.height};
+    }
+
+    // Rows are independent; the ones through the set take longest. A
+    // coarse row is colored from the sample row above it, so every row is
+    // sampled before any is colored.
+    if (job.kept.width < view.width || job.kept.height < view.height) {
+        parallel_for_rows(buffer, mandelbrot_sample_row, &job);
+    }
+    parallel_for_rows(buffer, mandelbrot_color_row, &job);
+    mandelbrot->field_view = view;
+    mandelbrot->field_step = job.step;
+    mandelbrot->pan_x = mandelbrot->pan_y = 0;
+}
+
+double mandelbrot_next_change(void *state, double time_elapsed) {
+    const MandelbrotState *mandelbrot = state;
+    // Refining passes go one per frame; after that only panning and
+    // zooming change the view
+    return mandelbrot->field_step > 1 ? time_elapsed : NEXT_CHANGE_NEVER;
 }
 
-ArtModule get_mandelbrot_module() {
-    return (ArtModule){
+ArtModuleV2 get_mandelbrot_module() {
+    return (ArtModuleV2){
         .name = "mandelbrot",
         .description = "A journey into the Mandelbrot fractal set",
-        .init = NULL,
-        .update = mandelbrot_update,
+        .create = mandelbrot_create,
         .draw = mandelbrot_draw,
-        .destroy = NULL,
+        .destroy = mandelbrot_destroy,
+        .resize = mandelbrot_resize,
         .handle_input = mandelbrot_handle_input,
+        .next_change = mandelbrot_next_change,
     };
 }
@@ -0,0 +1,267 @@
+#include "art_mandelbrot_deep.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Squared escape radius, as in the direct kernel
+#define ESCAPE_RADIUS_SQ 65536.0
+// The series stands in for the iteration while its last term stays below
+// this fraction of its first...
+#define SERIES_TOLERANCE 0x1p-40
+// ...and while cells stay this close to the reference orbit
+#define SERIES_MAX_DELTA 1e-2
+// How close z has to come back to where it was, next to the size of the
+// difference from the reference, to count as caught in a cycle. Checked
+// every few iterations against the z kept at powers of two, as the direct
+// kernel does.
+#define CYCLE_EPS 1e-13
+#define CYCLE_CHECK_INTERVAL 8
+
+// --- Fixed point ---
+
+static int is_zero(const DeepFixed *value) {
+    for (int i = 0; i < DEEP_LIMBS; i++) {
+        if (value->limb[i]) return 0;
+    }
+    return 1;
+}
+
+static int magnitude_compare(const uint32_t *a, const uint32_t *b) {
+    for (int i = 0; i < DEEP_LIMBS; i++) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void magnitude_add(uint32_t *out, const uint32_t *a, const uint32_t *b) {
+    uint64_t carry = 0;
+    for (int i = DEEP_LIMBS - 1; i >= 0; i--) {
+        uint64_t sum = (uint64_t)a[i] + b[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+// a - b, for a >= b
+static void magnitude_sub(uint32_t *out, const uint32_t *a, const uint32_t *b) {
+    int64_t borrow = 0;
+    for (int i = DEEP_LIMBS - 1; i >= 0; i--) {
+        int64_t diff = (int64_t)a[i] - b[i] - borrow;
+        borrow = diff < 0;
+        out[i] = (uint32_t)diff;
+    }
+}
+
+// out may be a or b in all of these
+static void fixed_add(DeepFixed *out, const DeepFixed *a, const DeepFixed *b) {
+    if (a->negative == b->negative) {
+        magnitude_add(out->limb, a->limb, b->limb);
+        out->negative = a->negative;
+    } else if (magnitude_compare(a->limb, b->limb) >= 0) {
+        magnitude_sub(out->limb, a->limb, b->limb);
+        out->negative = a->negative;
+    } else {
+        magnitude_sub(out->limb, b->limb, a->limb);
+        out->negative = b->negative;
+    }
+    if (is_zero(out)) out->negative = 0;
+}
+
+static void fixed_sub(DeepFixed *out, const DeepFixed *a, const DeepFixed *b) {
+    DeepFixed negated = *b;
+    negated.negative = !is_zero(b) && !b->negative;
+    fixed_add(out, a, &negated);
+}
+
+// Schoolbook, dropping the partial products below the last limb
+static void fixed_mul(DeepFixed *out, const DeepFixed *a, const DeepFixed *b) {
+    // sums[p + 1] collects the parts weighing 2^(-32p); sums[0] is what
+    // overflows the integer limb, which the orbit never reaches
+    uint64_t sums[DEEP_LIMBS + 1] = {0};
+    for (int i = 0; i < DEEP_LIMBS; i++) {
+        if (!a->limb[i]) continue;
+        for (int j = 0; i + j < DEEP_LIMBS; j++) {
+            uint64_t product = (uint64_t)a->limb[i] * b->limb[j];
+            sums[i + j + 1] += (uint32_t)product;
+            sums[i + j] += product >> 32;
+        }
+    }
+    for (int k = DEEP_LIMBS; k > 0; k--) {
+        sums[k - 1] += sums[k] >> 32;
+        sums[k] &= 0xffffffffu;
+    }
+
+    int negative = a->negative != b->negative;
+    for (int i = 0; i < DEEP_LIMBS; i++) out->limb[i] = (uint32_t)sums[i + 1];
+    out->negative = negative && !is_zero(out);
+}
+
+void deep_fixed_from_double(DeepFixed *out, double value) {
+    memset(out, 0, sizeof(*out));
+    // Every step is exact: the fraction only ever loses its integer part
+    // and is scaled by a power of two
+    double magnitude = fabs(value);
+    for (int i = 0; i < DEEP_LIMBS && magnitude > 0; i++) {
+        double whole = floor(magnitude);
+        out->limb[i] = (uint32_t)whole;
+        magnitude = (magnitude - whole) * 4294967296.0;
+    }
+    out->negative = value < 0 && !is_zero(out);
+}
+
+double deep_fixed_to_double(const DeepFixed *value) {
+    double result = 0;
+    for (int i = DEEP_LIMBS - 1; i >= 0; i--) result = result / 4294967296.0 + value->limb[i];
+    return value->negative ? -result : result;
+}
+
+void deep_fixed_add_double(DeepFixed *value, double delta) {
+    DeepFixed fixed;
+    deep_fixed_from_double(&fixed, delta);
+    fixed_add(value, value, &fixed);
+}
+
+// --- Perturbation ---
+
+int mandelbrot_deep_needed(double center_re, double center_im, double range, int width) {
+    // A double carries 53 bits; keep 11 of them spare for the error the
+    // iteration piles up, as the float kernel keeps 9
+    double spacing = range / width;
+    double reach_re = fabs(center_re) + range / 2;
+    double reach_im = fabs(center_im) + range / 4;
+    double reach = reach_re > reach_im ? reach_re : reach_im;
+    return spacing < ldexp(reach, -42);
+}
+
+int mandelbrot_deep_set_reference(MandelbrotDeep *deep, const DeepFixed *re, const DeepFixed *im, int max_iter) {
+    if (max_iter + 1 > deep->capacity) {
+        double *orbit_re = realloc(deep->orbit_re, (max_iter + 1) * sizeof(double));
+        if (!orbit_re) return 0;
+        deep->orbit_re = orbit_re;
+        double *orbit_im = realloc(deep->orbit_im, (max_iter + 1) * sizeof(double));
+        if (!orbit_im) return 0;
+        deep->orbit_im = orbit_im;
+        deep->capacity = max_iter + 1;
+    }
+
+    DeepFixed zr = {0}, zi = {0}, zr2, zi2, product;
+    deep->orbit_re[0] = deep->orbit_im[0] = 0;
+    int length = 1;
+    while (length <= max_iter) {
+        fixed_mul(&zr2, &zr, &zr);
+        fixed_mul(&zi2, &zi, &zi);
+        fixed_mul(&product, &zr, &zi);
+        fixed_sub(&zr, &zr2, &zi2);
+        fixed_add(&zr, &zr, re);
+        fixed_add(&zi, &product, &product);
+        fixed_add(&zi, &zi, im);
+
+        double x = deep_fixed_to_double(&zr), y = deep_fixed_to_double(&zi);
+        deep->orbit_re[length] = x;
+        deep->orbit_im[length] = y;
+        length++;
+        if (x * x + y * y > ESCAPE_RADIUS_SQ) break;
+    }
+    deep->length = length;
+    deep->max_iter = max_iter;
+    deep->series_skip = 0;
+    return 1;
+}
+
+void mandelbrot_deep_set_extent(MandelbrotDeep *deep, double dc_max) {
+    // From d_(n+1) = 2 Z_n d_n + d_n^2 + dc:
+    // A' = 2ZA + 1, B' = 2ZB + A^2, C' = 2ZC + 2AB
+    double ar = 0, ai = 0, br = 0, bi = 0, cr = 0, ci = 0;
+    int n = 0;
+    // Stop short of the last entry, which may have escaped
+    while (n + 1 < deep->length - 1) {
+        double zr = deep->orbit_re[n], zi = deep->orbit_im[n];
+        double next_ar = 2 * (zr * ar - zi * ai) + 1;
+        double next_ai = 2 * (zr * ai + zi * ar);
+        double next_br = 2 * (zr * br - zi * bi) + ar * ar - ai * ai;
+        double next_bi = 2 * (zr * bi + zi * br) + 2 * ar * ai;
+        double next_cr = 2 * (zr * cr - zi * ci) + 2 * (ar * br - ai * bi);
+        double next_ci = 2 * (zr * ci + zi * cr) + 2 * (ar * bi + ai * br);
+
+        double a = hypot(next_ar, next_ai), c = hypot(next_cr, next_ci);
+        if (!(c * dc_max * dc_max <= SERIES_TOLERANCE * a) || a * dc_max > SERIES_MAX_DELTA) break;
+        ar = next_ar; ai = next_ai;
+        br = next_br; bi = next_bi;
+        cr = next_cr; ci = next_ci;
+        n++;
+    }
+    deep->series_skip = n;
+    deep->a_re = ar; deep->a_im = ai;
+    deep->b_re = br; deep->b_im = bi;
+    deep->c_re = cr; deep->c_im = ci;
+}
+
+int mandelbrot_deep_iterate(const MandelbrotDeep *deep, double dc_re, double dc_im, int max_iter,
+                            double *zr_out, double *zi_out) {
+    const double *orbit_re = deep->orbit_re, *orbit_im = deep->orbit_im;
+
+    // Start where the series leaves off
+    double dc2_re = dc_re * dc_re - dc_im * dc_im, dc2_im = 2 * dc_re * dc_im;
+    double dc3_re = dc2_re * dc_re - dc2_im * dc_im, dc3_im = dc2_re * dc_im + dc2_im * dc_re;
+    double dr = deep->a_re * dc_re - deep->a_im * dc_im + deep->b_re * dc2_re - deep->b_im * dc2_im +
+                deep->c_re * dc3_re - deep->c_im * dc3_im;
+    double di = deep->a_re * dc_im + deep->a_im * dc_re + deep->b_re * dc2_im + deep->b_im * dc2_re +
+                deep->c_re * dc3_im + deep->c_im * dc3_re;
+    int n = deep->series_skip, iteration = n;
+
+    // z is kept as its reference and difference parts, and compared part
+    // by part. At deep zooms all cells are the same z to a double, so a
+    // cycle of the reference orbit alone must not catch a cell whose
+    // difference is still moving.
+    double saved_zr = 0, saved_zi = 0, saved_dr = 0, saved_di = 0;
+    int saved = 0, next_save = iteration > 0 ? iteration : 1;
+
+    double zr = 0, zi = 0;
+    while (iteration < max_iter) {
+        zr = orbit_re[n] + dr;
+        zi = orbit_im[n] + di;
+        double magnitude = zr * zr + zi * zi;
+        if (magnitude > ESCAPE_RADIUS_SQ) break;
+        if (saved && iteration % CYCLE_CHECK_INTERVAL == 0) {
+            double moved = fabs(orbit_re[n] - saved_zr + (dr - saved_dr)) +
+                           fabs(orbit_im[n] - saved_zi + (di - saved_di));
+            if (moved <= CYCLE_EPS * (fabs(dr) + fabs(di))) {
+                iteration = max_iter;
+                break;
+            }
+        }
+        if (iteration == next_save) {
+            saved_zr = orbit_re[n];
+            saved_zi = orbit_im[n];
+            saved_dr = dr;
+            saved_di = di;
+            saved = 1;
+            next_save *= 2;
+        }
+        // Once z is nearer 0 than the reference orbit, or the reference
+        // has run out, carry on from the start of the orbit with z itself
+        // as the difference (Z_0 is 0). This keeps the difference small
+        // enough for doubles wherever the reference is.
+        if (magnitude < dr * dr + di * di || n == deep->length - 1) {
+            dr = zr;
+            di = zi;
+            n = 0;
+        }
+        // d' = 2 Z d + d^2 + dc
+        double two_zr = 2 * orbit_re[n] + dr, two_zi = 2 * orbit_im[n] + di;
+        double next_dr = two_zr * dr - two_zi * di + dc_re;
+        di = two_zr * di + two_zi * dr + dc_im;
+        dr = next_dr;
+        n++;
+        iteration++;
+    }
+    *zr_out = zr;
+    *zi_out = zi;
+    return iteration;
+}
+
+void mandelbrot_deep_free(MandelbrotDeep *deep) {
+    free(deep->orbit_re);
+    free(deep->orbit_im);
+    memset(deep, 0, sizeof(*deep));
+}
@@ -0,0 +1,62 @@
+#ifndef ART_MANDELBROT_DEEP_H
+#define ART_MANDELBROT_DEEP_H
+
+#include <stdint.h>
+
+// Deep zoom. Past what a double can tell apart, one point of the view (the
+// reference) is iterated in fixed point, and every cell only tracks how
+// far its orbit is from the reference orbit, which fits in a double again.
+
+// Limbs of a fixed-point number: one for the integer part, the rest for
+// 480 bits of fraction
+#define DEEP_LIMBS 16
+// How far in the explorer goes; the fraction bits must stay well below
+// the cell spacing
+#define MANDELBROT_MIN_RANGE 1e-120
+
+// Sign and magnitude; limb[0] is the integer part, limb[1] the first 32
+// bits of fraction and so on. All zero is 0.
+typedef struct {
+    int negative;
+    uint32_t limb[DEEP_LIMBS];
+} DeepFixed;
+
+void deep_fixed_from_double(DeepFixed *out, double value);
+double deep_fixed_to_double(const DeepFixed *value);
+// value += delta
+void deep_fixed_add_double(DeepFixed *value, double delta);
+
+// The reference orbit, and the series that stands in for the first
+// iterations of every cell of a view
+typedef struct MandelbrotDeep {
+    double *orbit_re, *orbit_im; // Z_0 = 0, Z_1 = reference, ...
+    int length;                  // Entries in the orbit; the last may have escaped
+    int capacity;
+    int max_iter;                // The orbit was worked out this far
+    // For the first series_skip iterations, a cell dc away from the
+    // reference is A dc + B dc^2 + C dc^3 away from its orbit
+    int series_skip;
+    double a_re, a_im, b_re, b_im, c_re, c_im;
+} MandelbrotDeep;
+
+// Whether a view needs deep zoom: when neighbouring cells are too close
+// for the iteration in doubles to keep them apart
+int mandelbrot_deep_needed(double center_re, double center_im, double range, int width);
+
+// Work out the orbit of the reference point (re, im), up to max_iter.
+// Returns 0 when out of memory.
+int mandelbrot_deep_set_reference(MandelbrotDeep *deep, const DeepFixed *re, const DeepFixed *im, int max_iter);
+
+// Work out the series for a view whose cells are at most dc_max from the
+// reference
+void mandelbrot_deep_set_extent(MandelbrotDeep *deep, double dc_max);
+
+// Iterate the cell (dc_re, dc_im) away from the reference. Returns the
+// iteration count (max_iter if it never escapes or its orbit settles into
+// a cycle) and leaves the last z in zr, zi.
+int mandelbrot_deep_iterate(const MandelbrotDeep *deep, double dc_re, double dc_im, int max_iter,
+                            double *zr, double *zi);
+
+void mandelbrot_deep_free(MandelbrotDeep *deep);
+
+#endif // ART_MANDELBROT_DEEP_H
@@ -0,0 +1,475 @@
+#include "art_mandelbrot_kernel.h"
+#include "art_mandelbrot_deep.h"
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86 1
+#endif
+
+// Squared escape radius; large so the smooth coloring comes out accurate
+#define ESCAPE_RADIUS_SQ 65536.0
+// Most lanes any batch function works on
+#define MAX_LANES 16
+// How close (|dx| + |dy|) z has to come back to where it was to count as
+// caught in a cycle, which means the point is in the set
+#define FLOAT_CYCLE_EPS 1e-6f
+#define DOUBLE_CYCLE_EPS 1e-13
+// Iterations between cycle checks. A power of two: the kept z are from
+// power-of-two iterations too, so a cycle of period p is still caught
+// within 8p iterations of the one it was kept at.
+#define CYCLE_CHECK_INTERVAL 8
+
+// Iterate one batch of points: cr and ci hold the lanes' coordinates.
+// Reports each lane's iteration count (max_iter for points in the set) and
+// where z was when it stopped.
+typedef void (*BatchFn)(const double *cr, const double *ci, int max_iter,
+                        int *iterations, double *zr, double *zi);
+
+typedef struct {
+    const char *name;
+    int float_lanes;
+    BatchFn float_batch;
+    int double_lanes;
+    BatchFn double_batch;
+} Kernel;
+
+// Every batch runs the same loop. Besides stopping when z escapes, it
+// keeps z from iterations 1, 2, 4, 8, ... (Brent's method) and stops a
+// point once z is found back at the one kept: its orbit has settled into
+// a cycle, so it never escapes. Points in the set would otherwise run
+// all the way to max_iter.
+
+// --- Scalar ---
+
+static void batch_scalar(const double *cr, const double *ci, int max_iter,
+                         int *iterations, double *zr, double *zi) {
+    double x = 0, y = 0, saved_x = 0, saved_y = 0;
+    int iteration = 0, next_save = 1;
+    while (x * x + y * y <= ESCAPE_RADIUS_SQ && iteration < max_iter) {
+        double x_new = x * x - y * y + cr[0];
+        y = 2 * x * y + ci[0];
+        x = x_new;
+        iteration++;
+        if (iteration % CYCLE_CHECK_INTERVAL == 0 && fabs(x - saved_x) + fabs(y - saved_y) <= DOUBLE_CYCLE_EPS) {
+            iteration = max_iter;
+            break;
+        }
+        if (iteration == next_save) {
+            saved_x = x;
+            saved_y = y;
+            next_save *= 2;
+        }
+    }
+    iterations[0] = iteration;
+    zr[0] = x;
+    zi[0] = y;
+}
+
+// The vector batches follow the scalar loop lane by lane: a lane stops
+// being updated once it escapes or is caught, and the batch ends when all
+// have.
+
+#ifdef KERNEL_X86
+
+// --- SSE2: 4 floats / 2 doubles ---
+
+static void batch_sse2_float(const double *cr_in, const double *ci_in, int max_iter,
+                             int *iterations, double *zr_out, double *zi_out) {
+    const __m128 cr = _mm_setr_ps(cr_in[0], cr_in[1], cr_in[2], cr_in[3]);
+    const __m128 ci = _mm_setr_ps(ci_in[0], ci_in[1], ci_in[2], ci_in[3]);
+    const __m128 radius = _mm_set1_ps((float)ESCAPE_RADIUS_SQ);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 eps = _mm_set1_ps(FLOAT_CYCLE_EPS);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 zr = _mm_setzero_ps(), zi = _mm_setzero_ps(), count = _mm_setzero_ps();
+    __m128 saved_r = _mm_setzero_ps(), saved_i = _mm_setzero_ps();
+    __m128 live = _mm_castsi128_ps(_mm_set1_epi32(-1)), caught = _mm_setzero_ps();
+    for (int i = 0, next_save = 1; i < max_iter; i++) {
+        __m128 zr2 = _mm_mul_ps(zr, zr), zi2 = _mm_mul_ps(zi, zi);
+        __m128 active = _mm_and_ps(live, _mm_cmple_ps(_mm_add_ps(zr2, zi2), radius));
+        if (!_mm_movemask_ps(active)) break;
+        __m128 new_zi = _mm_add_ps(_mm_mul_ps(_mm_add_ps(zr, zr), zi), ci);
+        __m128 new_zr = _mm_add_ps(_mm_sub_ps(zr2, zi2), cr);
+        zr = _mm_or_ps(_mm_and_ps(active, new_zr), _mm_andnot_ps(active, zr));
+        zi = _mm_or_ps(_mm_and_ps(active, new_zi), _mm_andnot_ps(active, zi));
+        count = _mm_add_ps(count, _mm_and_ps(active, one));
+
+        if ((i + 1) % CYCLE_CHECK_INTERVAL == 0) {
+            __m128 distance = _mm_add_ps(_mm_andnot_ps(sign, _mm_sub_ps(zr, saved_r)),
+                                         _mm_andnot_ps(sign, _mm_sub_ps(zi, saved_i)));
+            __m128 cycled = _mm_and_ps(active, _mm_cmple_ps(distance, eps));
+            caught = _mm_or_ps(caught, cycled);
+            live = _mm_andnot_ps(cycled, active);
+        }
+        if (i + 1 == next_save) {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    float zr_lanes[4], zi_lanes[4], counts[4];
+    _mm_storeu_ps(zr_lanes, zr);
+    _mm_storeu_ps(zi_lanes, zi);
+    _mm_storeu_ps(counts, count);
+    int caught_lanes = _mm_movemask_ps(caught);
+    for (int j = 0; j < 4; j++) {
+        iterations[j] = caught_lanes & (1 << j) ? max_iter : (int)counts[j];
+        zr_out[j] = zr_lanes[j];
+        zi_out[j] = zi_lanes[j];
+    }
+}
+
+static void batch_sse2_double(const double *cr_in, const double *ci_in, int max_iter,
+                              int *iterations, double *zr_out, double *zi_out) {
+    const __m128d cr = _mm_loadu_pd(cr_in);
+    const __m128d ci = _mm_loadu_pd(ci_in);
+    const __m128d radius = _mm_set1_pd(ESCAPE_RADIUS_SQ);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d eps = _mm_set1_pd(DOUBLE_CYCLE_EPS);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    __m128d zr = _mm_setzero_pd(), zi = _mm_setzero_pd(), count = _mm_setzero_pd();
+    __m128d saved_r = _mm_setzero_pd(), saved_i = _mm_setzero_pd();
+    __m128d live = _mm_castsi128_pd(_mm_set1_epi32(-1)), caught = _mm_setzero_pd();
+    for (int i = 0, next_save = 1; i < max_iter; i++) {
+        __m128d zr2 = _mm_mul_pd(zr, zr), zi2 = _mm_mul_pd(zi, zi);
+        __m128d active = _mm_and_pd(live, _mm_cmple_pd(_mm_add_pd(zr2, zi2), radius));
+        if (!_mm_movemask_pd(active)) break;
+        __m128d new_zi = _mm_add_pd(_mm_mul_pd(_mm_add_pd(zr, zr), zi), ci);
+        __m128d new_zr = _mm_add_pd(_mm_sub_pd(zr2, zi2), cr);
+        zr = _mm_or_pd(_mm_and_pd(active, new_zr), _mm_andnot_pd(active, zr));
+        zi = _mm_or_pd(_mm_and_pd(active, new_zi), _mm_andnot_pd(active, zi));
+        count = _mm_add_pd(count, _mm_and_pd(active, one));
+
+        if ((i + 1) % CYCLE_CHECK_INTERVAL == 0) {
+            __m128d distance = _mm_add_pd(_mm_andnot_pd(sign, _mm_sub_pd(zr, saved_r)),
+                                          _mm_andnot_pd(sign, _mm_sub_pd(zi, saved_i)));
+            __m128d cycled = _mm_and_pd(active, _mm_cmple_pd(distance, eps));
+            caught = _mm_or_pd(caught, cycled);
+            live = _mm_andnot_pd(cycled, active);
+        }
+        if (i + 1 == next_save) {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    double counts[2];
+    _mm_storeu_pd(zr_out, zr);
+    _mm_storeu_pd(zi_out, zi);
+    _mm_storeu_pd(counts, count);
+    int caught_lanes = _mm_movemask_pd(caught);
+    for (int j = 0; j < 2; j++) iterations[j] = caught_lanes & (1 << j) ? max_iter : (int)counts[j];
+}
+
+// --- AVX2: 8 floats / 4 doubles ---
+
+__attribute__((target("avx2")))
+static void batch_avx2_float(const double *cr_in, const double *ci_in, int max_iter,
+                             int *iterations, double *zr_out, double *zi_out) {
+    const __m256 cr = _mm256_setr_ps(cr_in[0], cr_in[1], cr_in[2], cr_in[3],
+                                     cr_in[4], cr_in[5], cr_in[6], cr_in[7]);
+    const __m256 ci = _mm256_setr_ps(ci_in[0], ci_in[1], ci_in[2], ci_in[3],
+                                     ci_in[4], ci_in[5], ci_in[6], ci_in[7]);
+    const __m256 radius = _mm256_set1_ps((float)ESCAPE_RADIUS_SQ);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 eps = _mm256_set1_ps(FLOAT_CYCLE_EPS);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 zr = _mm256_setzero_ps(), zi = _mm256_setzero_ps(), count = _mm256_setzero_ps();
+    __m256 saved_r = _mm256_setzero_ps(), saved_i = _mm256_setzero_ps();
+    __m256 live = _mm256_castsi256_ps(_mm256_set1_epi32(-1)), caught = _mm256_setzero_ps();
+    for (int i = 0, next_save = 1; i < max_iter; i++) {
+        __m256 zr2 = _mm256_mul_ps(zr, zr), zi2 = _mm256_mul_ps(zi, zi);
+        __m256 active = _mm256_and_ps(live, _mm256_cmp_ps(_mm256_add_ps(zr2, zi2), radius, _CMP_LE_OQ));
+        if (!_mm256_movemask_ps(active)) break;
+        __m256 new_zi = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(zr, zr), zi), ci);
+        __m256 new_zr = _mm256_add_ps(_mm256_sub_ps(zr2, zi2), cr);
+        zr = _mm256_blendv_ps(zr, new_zr, active);
+        zi = _mm256_blendv_ps(zi, new_zi, active);
+        count = _mm256_add_ps(count, _mm256_and_ps(active, one));
+
+        if ((i + 1) % CYCLE_CHECK_INTERVAL == 0) {
+            __m256 distance = _mm256_add_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(zr, saved_r)),
+                                            _mm256_andnot_ps(sign, _mm256_sub_ps(zi, saved_i)));
+            __m256 cycled = _mm256_and_ps(active, _mm256_cmp_ps(distance, eps, _CMP_LE_OQ));
+            caught = _mm256_or_ps(caught, cycled);
+            live = _mm256_andnot_ps(cycled, active);
+        }
+        if (i + 1 == next_save) {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    float zr_lanes[8], zi_lanes[8], counts[8];
+    _mm256_storeu_ps(zr_lanes, zr);
+    _mm256_storeu_ps(zi_lanes, zi);
+    _mm256_storeu_ps(counts, count);
+    int caught_lanes = _mm256_movemask_ps(caught);
+    for (int j = 0; j < 8; j++) {
+        iterations[j] = caught_lanes & (1 << j) ? max_iter : (int)counts[j];
+        zr_out[j] = zr_lanes[j];
+        zi_out[j] = zi_lanes[j];
+    }
+}
+
+__attribute__((target("avx2")))
+static void batch_avx2_double(const double *cr_in, const double *ci_in, int max_iter,
+                              int *iterations, double *zr_out, double *zi_out) {
+    const __m256d cr = _mm256_loadu_pd(cr_in);
+    const __m256d ci = _mm256_loadu_pd(ci_in);
+    const __m256d radius = _mm256_set1_pd(ESCAPE_RADIUS_SQ);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d eps = _mm256_set1_pd(DOUBLE_CYCLE_EPS);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d zr = _mm256_setzero_pd(), zi = _mm256_setzero_pd(), count = _mm256_setzero_pd();
+    __m256d saved_r = _mm256_setzero_pd(), saved_i = _mm256_setzero_pd();
+    __m256d live = _mm256_castsi256_pd(_mm256_set1_epi32(-1)), caught = _mm256_setzero_pd();
+    for (int i = 0, next_save = 1; i < max_iter; i++) {
+        __m256d zr2 = _mm256_mul_pd(zr, zr), zi2 = _mm256_mul_pd(zi, zi);
+        __m256d active = _mm256_and_pd(live, _mm256_cmp_pd(_mm256_add_pd(zr2, zi2), radius, _CMP_LE_OQ));
+        if (!_mm256_movemask_pd(active)) break;
+        __m256d new_zi = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(zr, zr), zi), ci);
+        __m256d new_zr = _mm256_add_pd(_mm256_sub_pd(zr2, zi2), cr);
+        zr = _mm256_blendv_pd(zr, new_zr, active);
+        zi = _mm256_blendv_pd(zi, new_zi, active);
+        count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+
+        if ((i + 1) % CYCLE_CHECK_INTERVAL == 0) {
+            __m256d distance = _mm256_add_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(zr, saved_r)),
+                                             _mm256_andnot_pd(sign, _mm256_sub_pd(zi, saved_i)));
+            __m256d cycled = _mm256_and_pd(active, _mm256_cmp_pd(distance, eps, _CMP_LE_OQ));
+            caught = _mm256_or_pd(caught, cycled);
+            live = _mm256_andnot_pd(cycled, active);
+        }
+        if (i + 1 == next_save) {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    double counts[4];
+    _mm256_storeu_pd(zr_out, zr);
+    _mm256_storeu_pd(zi_out, zi);
+    _mm256_storeu_pd(counts, count);
+    int caught_lanes = _mm256_movemask_pd(caught);
+    for (int j = 0; j < 4; j++) iterations[j] = caught_lanes & (1 << j) ? max_iter : (int)counts[j];
+}
+
+// --- AVX-512: 16 floats / 8 doubles, with mask registers ---
+
+__attribute__((target("avx512f")))
+static void batch_avx512_float(const double *cr_in, const double *ci_in, int max_iter,
+                               int *iterations, double *zr_out, double *zi_out) {
+    float cr_lanes[16], ci_lanes[16];
+    for (int j = 0; j < 16; j++) {
+        cr_lanes[j] = (float)cr_in[j];
+        ci_lanes[j] = (float)ci_in[j];
+    }
+    const __m512 cr = _mm512_loadu_ps(cr_lanes);
+    const __m512 ci = _mm512_loadu_ps(ci_lanes);
+    const __m512 radius = _mm512_set1_ps((float)ESCAPE_RADIUS_SQ);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 eps = _mm512_set1_ps(FLOAT_CYCLE_EPS);
+    __m512 zr = _mm512_setzero_ps(), zi = _mm512_setzero_ps(), count = _mm512_setzero_ps();
+    __m512 saved_r = _mm512_setzero_ps(), saved_i = _mm512_setzero_ps();
+    __mmask16 live = 0xffff, caught = 0;
+    for (int i = 0, next_save = 1; i < max_iter; i++) {
+        __m512 zr2 = _mm512_mul_ps(zr, zr), zi2 = _mm512_mul_ps(zi, zi);
+        __mmask16 active = _mm512_mask_cmp_ps_mask(live, _mm512_add_ps(zr2, zi2), radius, _CMP_LE_OQ);
+        if (!active) break;
+        __m512 new_zi = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(zr, zr), zi), ci);
+        __m512 new_zr = _mm512_add_ps(_mm512_sub_ps(zr2, zi2), cr);
+        zr = _mm512_mask_mov_ps(zr, active, new_zr);
+        zi = _mm512_mask_mov_ps(zi, active, new_zi);
+        count = _mm512_mask_add_ps(count, active, count, one);
+
+        if ((i + 1) % CYCLE_CHECK_INTERVAL == 0) {
+            __m512 distance = _mm512_add_ps(_mm512_abs_ps(_mm512_sub_ps(zr, saved_r)),
+                                            _mm512_abs_ps(_mm512_sub_ps(zi, saved_i)));
+            __mmask16 cycled = _mm512_mask_cmp_ps_mask(active, distance, eps, _CMP_LE_OQ);
+            caught |= cycled;
+            live = active & ~cycled;
+        }
+        if (i + 1 == next_save) {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    float zr_lanes[16], zi_lanes[16], counts[16];
+    _mm512_storeu_ps(zr_lanes, zr);
+    _mm512_storeu_ps(zi_lanes, zi);
+    _mm512_storeu_ps(counts, count);
+    for (int j = 0; j < 16; j++) {
+        iterations[j] = caught & (1 << j) ? max_iter : (int)counts[j];
+        zr_out[j] = zr_lanes[j];
+        zi_out[j] = zi_lanes[j];
+    }
+}
+
+__attribute__((target("avx512f")))
+static void batch_avx512_double(const double *cr_in, const double *ci_in, int max_iter,
+                                int *iterations, double *zr_out, double *zi_out) {
+    const __m512d cr = _mm512_loadu_pd(cr_in);
+    const __m512d ci = _mm512_loadu_pd(ci_in);
+    const __m512d radius = _mm512_set1_pd(ESCAPE_RADIUS_SQ);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d eps = _mm512_set1_pd(DOUBLE_CYCLE_EPS);
+    __m512d zr = _mm512_setzero_pd(), zi = _mm512_setzero_pd(), count = _mm512_setzero_pd();
+    __m512d saved_r = _mm512_setzero_pd(), saved_i = _mm512_setzero_pd();
+    __mmask8 live = 0xff, caught = 0;
+    for (int i = 0, next_save = 1; i < max_iter; i++) {
+        __m512d zr2 = _mm512_mul_pd(zr, zr), zi2 = _mm512_mul_pd(zi, zi);
+        __mmask8 active = _mm512_mask_cmp_pd_mask(live, _mm512_add_pd(zr2, zi2), radius, _CMP_LE_OQ);
+        if (!active) break;
+        __m512d new_zi = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(zr, zr), zi), ci);
+        __m512d new_zr = _mm512_add_pd(_mm512_sub_pd(zr2, zi2), cr);
+        zr = _mm512_mask_mov_pd(zr, active, new_zr);
+        zi = _mm512_mask_mov_pd(zi, active, new_zi);
+        count = _mm512_mask_add_pd(count, active, count, one);
+
+        if ((i + 1) % CYCLE_CHECK_INTERVAL == 0) {
+            __m512d distance = _mm512_add_pd(_mm512_abs_pd(_mm512_sub_pd(zr, saved_r)),
+                                             _mm512_abs_pd(_mm512_sub_pd(zi, saved_i)));
+            __mmask8 cycled = _mm512_mask_cmp_pd_mask(active, distance, eps, _CMP_LE_OQ);
+            caught |= cycled;
+            live = active & ~cycled;
+        }
+        if (i + 1 == next_save) {
+            saved_r = zr;
+            saved_i = zi;
+            next_save *= 2;
+        }
+    }
+    double counts[8];
+    _mm512_storeu_pd(zr_out, zr);
+    _mm512_storeu_pd(zi_out, zi);
+    _mm512_storeu_pd(counts, count);
+    for (int j = 0; j < 8; j++) iterations[j] = caught & (1 << j) ? max_iter : (int)counts[j];
+}
+
+#endif // KERNEL_X86
+
+static const Kernel kernels[] = {
+#ifdef KERNEL_X86
+    {"avx512", 16, batch_avx512_float, 8, batch_avx512_double},
+    {"avx2", 8, batch_avx2_float, 4, batch_avx2_double},
+    {"sse2", 4, batch_sse2_float, 2, batch_sse2_double},
+#endif
+    {"scalar", 1, batch_scalar, 1, batch_scalar},
+};
+
+// The widest kernel this CPU runs. Cheap enough to ask every row, which
+// saves keeping a once-only flag that the drawing threads would share.
+static const Kernel *pick_kernel() {
+#ifdef KERNEL_X86
+    if (__builtin_cpu_supports("avx512f")) return &kernels[0];
+    if (__builtin_cpu_supports("avx2")) return &kernels[1];
+    return &kernels[2];
+#else
+    return &kernels[0];
+#endif
+}
+
+const char *mandelbrot_kernel_isa() {
+    return pick_kernel()->name;
+}
+
+int mandelbrot_max_iter(double range) {
+    // 256 at the starting range, and more the further in: each halving of
+    // the range lets finer filaments show, which take longer to escape
+    double depth = log2(4.0 / range);
+    if (!(depth > 0)) return 256;
+    double max_iter = 256 + 48 * depth;
+    return max_iter < 65536 ? (int)max_iter : 65536;
+}
+
+// A float carries 24 bits. Neighbouring cells stay apart, with bits to
+// spare for the error the iteration piles up, while the cell spacing is
+// above 2^-15 of the largest coordinate on screen.
+static int fits_in_float(const MandelbrotView *view) {
+    double spacing = view->range / view->width;
+    double reach_re = fabs(view->center_re) + view->range / 2;
+    double reach_im = fabs(view->center_im) + view->range / 4;
+    double reach = reach_re > reach_im ? reach_re : reach_im;
+    return spacing >= ldexp(reach, -15);
+}
+
+// Whether c lies in the main cardioid or the period-2 bulb, the two
+// largest parts of the set, which can be told without iterating
+static int in_main_bulbs(double re, double im) {
+    double x = re - 0.25, y2 = im * im;
+    double q = x * x + y2;
+    if (q * (q + x) <= 0.25 * y2) return 1;
+    return (re + 1) * (re + 1) + y2 <= 0.0625;
+}
+
+// The smooth escape value of a point that stopped after iteration steps at z
+static float smooth_value(int iteration, int max_iter, double zr, double zi) {
+    if (iteration >= max_iter) return -1;
+    double log_zn = log(zr * zr + zi * zi) / 2;
+    double nu = log(log_zn / log(2)) / log(2);
+    return (float)(iteration + 1 - nu);
+}
+
+// Escape values of count cells from (x0, y0), each (dx, dy) from the last
+static void kernel_line(const MandelbrotView *view, int x0, int y0, int dx, int dy, int count, float *out) {
+    // Deep views go cell by cell along the reference orbit; the bulb test
+    // would need the absolute point, which a double no longer holds
+    if (view->deep) {
+        for (int k = 0; k < count; k++) {
+            double zr, zi;
+            double dc_re = mandelbrot_cell_re(view, x0 + (double)k * dx);
+            double dc_im = mandelbrot_cell_im(view, y0 + (double)k * dy);
+            int iteration = mandelbrot_deep_iterate(view->deep, dc_re, dc_im, view->max_iter, &zr, &zi);
+            out[k] = smooth_value(iteration, view->max_iter, zr, zi);
+        }
+        return;
+    }
+
+    const Kernel *kernel = pick_kernel();
+    int use_float = fits_in_float(view);
+    int lanes = use_float ? kernel->float_lanes : kernel->double_lanes;
+    BatchFn batch = use_float ? kernel->float_batch : kernel->double_batch;
+
+    double cr[MAX_LANES], ci[MAX_LANES], zr[MAX_LANES], zi[MAX_LANES];
+    int iterations[MAX_LANES], cell[MAX_LANES];
+    int filled = 0;
+    for (int k = 0; k <= count; k++) {
+        // Cells in the main bulbs are filled in directly; the rest are
+        // packed into batches
+        if (k < count) {
+            double re = mandelbrot_cell_re(view, x0 + (double)k * dx);
+            double im = mandelbrot_cell_im(view, y0 + (double)k * dy);
+            if (in_main_bulbs(re, im)) {
+                out[k] = -1;
+                continue;
+            }
+            cell[filled] = k;
+            cr[filled] = re;
+            ci[filled] = im;
+            filled++;
+            if (filled < lanes) continue;
+        }
+        if (filled == 0) break;
+
+        // Spare lanes repeat the last cell so they finish with it
+        for (int j = filled; j < lanes; j++) {
+            cr[j] = cr[filled - 1];
+            ci[j] = ci[filled - 1];
+        }
+        batch(cr, ci, view->max_iter, iterations, zr, zi);
+        for (int j = 0; j < filled; j++) {
+            out[cell[j]] = smooth_value(iterations[j], view->max_iter, zr[j], zi[j]);
+        }
+        filled = 0;
+    }
+}
+
+void mandelbrot_kernel_row(const MandelbrotView *view, int y, int x0, int step, int count, float *out) {
+    kernel_line(view, x0, y, step, 0, count, out);
+}
+
+void mandelbrot_kernel_column(const MandelbrotView *view, int x, int y0, int count, float *out) {
+    kernel_line(view, x, y0, 0, 1, count, out);
+}
@@ -0,0 +1,41 @@
+#ifndef ART_MANDELBROT_KERNEL_H
+#define ART_MANDELBROT_KERNEL_H
+
+// The part of the complex plane on screen
+typedef struct {
+    double center_re, center_im;
+    double range;        // Width of the screen in the plane
+    int width, height;   // Screen size in cells
+    int max_iter;
+    // Set for deep views, whose center is then given relative to the
+    // deep zoom reference, and so is every cell
+    const struct MandelbrotDeep *deep;
+} MandelbrotView;
+
+// Where cell (x, y) lands in the plane. Cells are twice as tall as wide.
+static inline double mandelbrot_cell_re(const MandelbrotView *view, double x) {
+    return view->center_re + (x - view->width / 2.0) * view->range / view->width;
+}
+static inline double mandelbrot_cell_im(const MandelbrotView *view, double y) {
+    return view->center_im + (y - view->height / 2.0) * view->range / view->width * 0.5;
+}
+
+// Escape values of count cells of row y, starting at x0 and step cells
+// apart: the smooth iteration count (>= 0) of points that escape, or -1
+// for points in the set. Runs as many cells per instruction as the CPU
+// allows, in float while the zoom is shallow enough and double past that.
+// Points in the main cardioid and period-2 bulb, and those whose orbit
+// settles into a cycle, are known to be in the set without running to
+// max_iter.
+void mandelbrot_kernel_row(const MandelbrotView *view, int y, int x0, int step, int count, float *out);
+
+// The same for count cells of column x from y0 down, into consecutive out
+void mandelbrot_kernel_column(const MandelbrotView *view, int x, int y0, int count, float *out);
+
+// Iterations a view of the given range needs to show its detail
+int mandelbrot_max_iter(double range);
+
+// The instruction set the kernel picked ("avx512", "avx2", "sse2", "scalar")
+const char *mandelbrot_kernel_isa();
+
+#endif // ART_MANDELBROT_KERNEL_H
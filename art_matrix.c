@@ -5,29 +5,62 @@
 #define MAX_DROPS 200
 
 typedef struct { int x; float y; int speed; int len; } Drop;
-static Drop drops[MAX_DROPS];
-static int num_drops;
-static double current_time = 0.0;
 
-void matrix_init(int width, int height, ColorPalette* palette) {
-    (void)palette;
+typedef struct {
+    Drop drops[MAX_DROPS];
+    int num_drops;
+    double current_time;
+} MatrixState;
+
+static void matrix_spawn_drop(Drop *drop, int width, int height) {
+    drop->x = rand() % width;
+    drop->y = (float)(rand() % (height * 2) - height);
+    drop->speed = rand() % 5 + 2;
+    // Make drops longer for a more persistent effect
+    drop->len = rand() % (height / 2) + (height / 4);
+}
+
+static int matrix_drop_count(int width) {
     // Increase the number of drops for a more saturated effect
-    num_drops = (int)(width * 0.75f) < MAX_DROPS ? (int)(width * 0.75f) : MAX_DROPS;
-    for (int i = 0; i < num_drops; i++) {
-        drops[i].x = rand() % width;
-        drops[i].y = (float)(rand() % (height * 2) - height);
-        drops[i].speed = rand() % 5 + 2;
-        // Make drops longer for a more persistent effect
-        drops[i].len = rand() % (height / 2) + (height / 4);
+    return (int)(width * 0.75f) < MAX_DROPS ? (int)(width * 0.75f) : MAX_DROPS;
+}
+
+void *matrix_create(int width, int height, ColorPalette* palette) {
+    (void)palette;
+    MatrixState *matrix = calloc(1, sizeof(MatrixState));
+    if (!matrix) return NULL;
+    matrix->num_drops = matrix_drop_count(width);
+    for (int i = 0; i < matrix->num_drops; i++) {
+        matrix_spawn_drop(&matrix->drops[i], width, height);
     }
+    return matrix;
 }
 
-void matrix_update(double progress, double time_elapsed) {
-    (void)progress; // No longer tied to slide progress
-    current_time = time_elapsed;
+void matrix_destroy(void *state) {
+    free(state);
+}
 
-    int width = get_buffer()->width;
-    int height = get_buffer()->height;
+// Keep the rain falling: only drops that no longer fit are respawned
+void matrix_resize(void *state, int width, int height) {
+    MatrixState *matrix = state;
+    Drop *drops = matrix->drops;
+    int new_count = matrix_drop_count(width);
+    for (int i = 0; i < new_count; i++) {
+        if (i >= matrix->num_drops || drops[i].x >= width || drops[i].len > height) {
+            matrix_spawn_drop(&drops[i], width, height);
+        }
+    }
+    matrix->num_drops = new_count;
+}
+
+void matrix_update(void *state, const ArtFrame *frame) {
+    MatrixState *matrix = state;
+    Drop *drops = matrix->drops;
+    int num_drops = matrix->num_drops;
+    matrix->current_time = frame->time;
+
+    int width = frame->width;
+    int height = frame->height;
 
     for (int i = 0; i < num_drops; i++) {
         drops[i].y += drops[i].speed / 20.0f;
@@ -39,10 +72,16 @@ void matrix_update(double progress, double time_elapsed) {
     }
 }
 
-void matrix_draw(ScreenBuffer *buffer, ColorPalette* palette) {
+void matrix_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    const MatrixState *matrix = state;
+    const Drop *drops = matrix->drops;
+    int num_drops = matrix->num_drops;
+    double current_time = matrix->current_time;
+    ColorPalette *palette = frame->palette;
+
     // Dim the screen using the old-style random blanking
     for(int i = 0; i < buffer->width * buffer->height; i++) {
-        if (rand() % 10 > 7) buffer->cells[i].character = ' ';
+        if (rand() % 10 > 7) buffer->glyphs[i] = ' ';
     }
 
     for (int i = 0; i < num_drops; i++) {
@@ -69,24 +108,25 @@ void matrix_draw(ScreenBuffer *buffer, ColorPalette* palette) {
                     .g = (unsigned char)(base_color.g * fade),
                     .b = (unsigned char)(base_color.b * fade)
                 };
-                buffer_draw_char(drops[i].x, y, ' ' + (rand() % 94), c, (Color){0,0,0});
+                buffer_set_char(buffer, drops[i].x, y, ' ' + (rand() % 94), c, (Color){0,0,0});
             }
         }
 
         // The head of the drop is the classic bright white-green color
         if (head_y >= 0 && head_y < buffer->height && drops[i].x >= 0 && drops[i].x < buffer->width) {
-            buffer_draw_char(drops[i].x, head_y, ' ' + (rand() % 94), (Color){200, 255, 200}, (Color){0,0,0});
+            buffer_set_char(buffer, drops[i].x, head_y, ' ' + (rand() % 94), (Color){200, 255, 200}, (Color){0,0,0});
         }
     }
 }
 
-ArtModule get_matrix_module() {
-    return (ArtModule){
+ArtModuleV2 get_matrix_module() {
+    return (ArtModuleV2){
         .name = "matrix",
         .description = "The classic digital rain effect",
-        .init = matrix_init,
+        .create = matrix_create,
         .update = matrix_update,
         .draw = matrix_draw,
-        .destroy = NULL,
+        .destroy = matrix_destroy,
+        .resize = matrix_resize,
     };
 }
@@ -7,10 +7,16 @@
 #include <stdlib.h>
 #include <string.h>
 
-static stbi_uc *image_data = NULL;
-static int image_width = 0;
-static int image_height = 0;
-static int image_channels = 0;
+typedef struct {
+    stbi_uc *image_data;
+    int image_width;
+    int image_height;
+    int image_channels;
+    // The 5 second period the card on screen is for; create() fetches the
+    // one for period 0, off the drawing thread when the slide is prepared
+    // ahead
+    int card_period;
+} MtgState;
 
 struct MemoryStruct {
   char *memory;
@@ -37,26 +43,40 @@ static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, voi
   return realsize;
 }
 
-static void mtg_fetch_and_display();
+static void mtg_fetch_and_display(MtgState *mtg);
 
-void mtg_init(int width, int height, ColorPalette* palette) {
+void *mtg_create(int width, int height, ColorPalette* palette) {
     (void)width; (void)height; (void)palette;
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    mtg_fetch_and_display();
+    MtgState *mtg = calloc(1, sizeof(MtgState));
+    if (!mtg) return NULL;
+    mtg_fetch_and_display(mtg);
+    return mtg;
 }
 
-void mtg_update(double progress, double time_elapsed) {
-    (void)progress;
+void mtg_update(void *state, const ArtFrame *frame) {
+    MtgState *mtg = state;
     // Every 5 seconds, fetch a new card
-    if (fmod(time_elapsed, 5.0) < 0.1) {
-        mtg_fetch_and_display();
+    int period = (int)floor(frame->time / 5.0);
+    if (period > mtg->card_period) {
+        mtg->card_period = period;
+        mtg_fetch_and_display(mtg);
     }
 }
 
-void mtg_draw(ScreenBuffer *buffer, ColorPalette* palette) {
-    (void)palette;
+double mtg_next_change(void *state, double time_elapsed) {
+    (void)state;
+    // The next card comes in at the next 5 second mark
+    return (floor(time_elapsed / 5.0) + 1) * 5.0;
+}
+
+void mtg_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    (void)frame;
+    const MtgState *mtg = state;
+    const stbi_uc *image_data = mtg->image_data;
+    int image_width = mtg->image_width;
+    int image_height = mtg->image_height;
     if (image_data == NULL) {
-        buffer_draw_text(1, 1, "Loading...", (Color){255, 255, 255}, (Color){0, 0, 0});
+        buffer_set_text(buffer, 1, 1, "Loading...", (Color){255, 255, 255}, (Color){0, 0, 0});
         return;
     }
 
@@ -81,15 +101,20 @@ void mtg_draw(ScreenBuffer *buffer, ColorPalette* palette) {
     }
 }
 
-void mtg_destroy() {
-    if (image_data) {
-        stbi_image_free(image_data);
-        image_data = NULL;
+void mtg_resize(void *state, int width, int height) {
+    // The card is scaled to the buffer on every draw; keep it instead of fetching a new one
+    (void)state; (void)width; (void)height;
+}
+
+void mtg_destroy(void *state) {
+    MtgState *mtg = state;
+    if (mtg->image_data) {
+        stbi_image_free(mtg->image_data);
     }
-    curl_global_cleanup();
+    free(mtg);
 }
 
-static void mtg_fetch_and_display() {
+static void mtg_fetch_and_display(MtgState *mtg) {
     CURL *curl_handle;
     CURLcode res;
 
@@ -144,10 +169,10 @@ static void mtg_fetch_and_display() {
                                 if(res != CURLE_OK) {
                                     fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
                                 } else {
-                                    if (image_data) {
-                                        stbi_image_free(image_data);
+                                    if (mtg->image_data) {
+                                        stbi_image_free(mtg->image_data);
                                     }
-                                    image_data = stbi_load_from_memory(img_chunk.memory, img_chunk.size, &image_width, &image_height, &image_channels, 3);
+                                    mtg->image_data = stbi_load_from_memory(img_chunk.memory, img_chunk.size, &mtg->image_width, &mtg->image_height, &mtg->image_channels, 3);
                                 }
                                 curl_easy_cleanup(img_curl_handle);
                                 free(img_chunk.memory);
@@ -164,14 +189,16 @@ static void mtg_fetch_and_display() {
     }
 }
 
-ArtModule get_mtg_module() {
-    return (ArtModule){
+ArtModuleV2 get_mtg_module() {
+    return (ArtModuleV2){
         .name = "mtg",
         .description = "Displays random Magic: The Gathering cards.",
-        .init = mtg_init,
+        .create = mtg_create,
         .update = mtg_update,
         .draw = mtg_draw,
         .destroy = mtg_destroy,
         .handle_input = NULL,
+        .resize = mtg_resize,
+        .next_change = mtg_next_change,
     };
 }
\ No newline at end of file
@@ -3,6 +3,6 @@
 
 #include "art.h"
 
-ArtModule get_mtg_module();
+ArtModuleV2 get_mtg_module();
 
 #endif // ART_MTG_H
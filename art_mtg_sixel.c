@@ -1,5 +1,6 @@
 #include "art_mtg_sixel.h"
 #include "buffer.h"
+#include "terminal.h"
 #include <sixel.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,7 +45,6 @@ static void mtg_sixel_fetch_random_card() {
     chunk.memory = malloc(1);
     chunk.size = 0;
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
     curl_handle = curl_easy_init();
     if(curl_handle) {
         curl_easy_setopt(curl_handle, CURLOPT_URL, "https://api.scryfall.com/cards/random");
@@ -108,7 +108,6 @@ static void mtg_sixel_fetch_random_card() {
         curl_easy_cleanup(curl_handle);
         free(chunk.memory);
     }
-    curl_global_cleanup();
 }
 
 
@@ -134,6 +133,7 @@ void mtg_sixel_draw(ScreenBuffer *buffer, ColorPalette* palette) {
     }
 
     if (pid == 0) {
+        term_unblock_signals();
         execlp("img2sixel", "img2sixel", TMP_IMAGE_PATH, NULL);
         perror("execlp");
         exit(1);
@@ -143,6 +143,11 @@ void mtg_sixel_draw(ScreenBuffer *buffer, ColorPalette* palette) {
     }
 }
 
+void mtg_sixel_resize(int width, int height) {
+    // The main loop redraws the image after a resize; keep the downloaded card
+    (void)width; (void)height;
+}
+
 void mtg_sixel_destroy() {
     remove(TMP_IMAGE_PATH);
 }
@@ -184,5 +189,6 @@ ArtModule get_mtg_sixel_module() {
         .draw = mtg_sixel_draw,
         .destroy = mtg_sixel_destroy,
         .handle_input = NULL,
+        .resize = mtg_sixel_resize,
     };
 }
\ No newline at end of file
@@ -2,42 +2,37 @@
 #include <math.h>
 #include <string.h>
 
-static double g_time_elapsed;
-static double g_progress;
-
-void plasma_update(double progress, double time_elapsed) {
-    g_progress = progress;
-    g_time_elapsed = time_elapsed;
-}
-
-void plasma_draw(ScreenBuffer *buffer, ColorPalette* palette) {
+static void plasma_draw_row(ScreenBuffer *buffer, int y, void *ctx) {
+    const ArtFrame *frame = ctx;
+    double time = frame->time;
+    double progress = frame->progress;
     const char* charset = " .:-=+*#%@";
     int charset_size = strlen(charset);
-    int color_shift = (int)(g_progress * 200.0);
 
-    for (int y = 0; y < buffer->height; y++) {
-        for (int x = 0; x < buffer->width; x++) {
-            double val = sin(x / 16.0 + g_time_elapsed) +
-                         sin(y / 8.0 - g_time_elapsed * 1.5) +
-                         sin(sqrt((double)(x - buffer->width / 2) * (x - buffer->width/2) + (y - buffer->height / 2) * (y - buffer->height / 2)) / 8.0 + g_time_elapsed);
+    for (int x = 0; x < buffer->width; x++) {
+        double val = sin(x / 16.0 + time) +
+                     sin(y / 8.0 - time * 1.5) +
+                     sin(sqrt((double)(x - buffer->width / 2) * (x - buffer->width/2) + (y - buffer->height / 2) * (y - buffer->height / 2)) / 8.0 + time);
 
-            float t = (val + 3.0) / 6.0;
-            Color c = get_palette_color(palette, t + g_progress);
+        float t = (val + 3.0) / 6.0;
+        Color c = get_palette_color(frame->palette, t + progress);
 
-            int char_index = (int)((val + 3.0) / 6.0 * charset_size);
-            char_index = fmax(0, fmin(charset_size - 1, char_index));
-            buffer_draw_char(x, y, charset[char_index], c, (Color){0,0,0});
-        }
+        int char_index = (int)((val + 3.0) / 6.0 * charset_size);
+        char_index = fmax(0, fmin(charset_size - 1, char_index));
+        buffer_set_char(buffer, x, y, charset[char_index], c, (Color){0,0,0});
     }
 }
 
-ArtModule get_plasma_module() {
-    return (ArtModule){
+// The picture is a function of the slide time alone, so there is no state
+void plasma_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    (void)state;
+    parallel_for_rows(buffer, plasma_draw_row, (void *)frame);
+}
+
+ArtModuleV2 get_plasma_module() {
+    return (ArtModuleV2){
         .name = "plasma",
         .description = "Flowing clouds of colorful plasma",
-        .init = NULL,
-        .update = plasma_update,
         .draw = plasma_draw,
-        .destroy = NULL,
     };
 }
@@ -4,31 +4,61 @@
 #define NUM_STARS 500
 
 typedef struct { float x, y, z; } Star;
-static Star stars[NUM_STARS];
-static float speed;
 
-void starfield_init(int width, int height, ColorPalette* palette) {
+typedef struct {
+    Star stars[NUM_STARS];
+    int field_width, field_height;
+} StarfieldState;
+
+void *starfield_create(int width, int height, ColorPalette* palette) {
+    (void)palette;
+    StarfieldState *field = malloc(sizeof(StarfieldState));
+    if (!field) return NULL;
+    field->field_width = width;
+    field->field_height = height;
+    for (int i = 0; i < NUM_STARS; i++) {
+        field->stars[i].x = (rand() % width) - width / 2;
+        field->stars[i].y = (rand() % height) - height / 2;
+        field->stars[i].z = rand() % width;
+    }
+    return field;
+}
+
+void starfield_destroy(void *state) {
+    free(state);
+}
+
+// Stretch the field to the new screen instead of scattering the stars again
+void starfield_resize(void *state, int width, int height) {
+    StarfieldState *field = state;
+    float sx = (float)width / field->field_width;
+    float sy = (float)height / field->field_height;
     for (int i = 0; i < NUM_STARS; i++) {
-        stars[i].x = (rand() % width) - width / 2;
-        stars[i].y = (rand() % height) - height / 2;
-        stars[i].z = rand() % width;
+        field->stars[i].x *= sx;
+        field->stars[i].y *= sy;
+        field->stars[i].z *= sx;
     }
+    field->field_width = width;
+    field->field_height = height;
 }
 
-void starfield_update(double progress, double time_elapsed) {
-    (void)time_elapsed;
-    speed = 0.5 + progress * 2.5;
+void starfield_update(void *state, const ArtFrame *frame) {
+    StarfieldState *field = state;
+    Star *stars = field->stars;
+    float speed = 0.5 + frame->progress * 2.5;
     for (int i = 0; i < NUM_STARS; i++) {
         stars[i].z -= speed;
         if (stars[i].z <= 0) {
-            stars[i].x = (rand() % get_buffer()->width) - get_buffer()->width / 2;
-            stars[i].y = (rand() % get_buffer()->height) - get_buffer()->height / 2;
-            stars[i].z = get_buffer()->width;
+            stars[i].x = (rand() % frame->width) - frame->width / 2;
+            stars[i].y = (rand() % frame->height) - frame->height / 2;
+            stars[i].z = frame->width;
         }
     }
 }
 
-void starfield_draw(ScreenBuffer *buffer, ColorPalette* palette) {
+void starfield_draw(void *state, ScreenBuffer *buffer, const ArtFrame *frame) {
+    const Star *stars = ((const StarfieldState *)state)->stars;
+    ColorPalette *palette = frame->palette;
     for (int i = 0; i < NUM_STARS; i++) {
         if (stars[i].z > 0) {
             int sx = (int)(stars[i].x / (stars[i].z * 0.005)) + buffer->width / 2;
@@ -40,19 +70,20 @@ void starfield_draw(ScreenBuffer *buffer, ColorPalette* palette) {
                 if (dist_ratio < 0.2) { character = '@'; c = palette->colors[0]; }
                 else if (dist_ratio < 0.5) { character = '*'; c = palette->colors[1]; }
                 else if (dist_ratio < 0.8) { character = '+'; c = palette->colors[2]; }
-                buffer_draw_char(sx, sy, character, c, (Color){0,0,0});
+                buffer_set_char(buffer, sx, sy, character, c, (Color){0,0,0});
             }
         }
     }
 }
 
-ArtModule get_starfield_module() {
-    return (ArtModule){
+ArtModuleV2 get_starfield_module() {
+    return (ArtModuleV2){
         .name = "starfield",
         .description = "Accelerating through a 3D starfield",
-        .init = starfield_init,
+        .create = starfield_create,
         .update = starfield_update,
         .draw = starfield_draw,
-        .destroy = NULL,
+        .destroy = starfield_destroy,
+        .resize = starfield_resize,
     };
 }
@@ -1,117 +1,405 @@
 #include "buffer.h"
+#include "encoder.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-static ScreenBuffer current_buffer;
-static ScreenBuffer prev_buffer;
+// Three frames: the one being drawn, the one last sent (what the terminal
+// shows) and one being encoded or waiting to be drawn into
+#define FRAME_COUNT 3
+static ScreenBuffer frames[FRAME_COUNT];
+static ScreenBuffer *current_buffer = &frames[0];
+static ScreenBuffer *prev_buffer = &frames[1];
 
-int init_buffer(int width, int height) {
-    current_buffer.width = width;
-    current_buffer.height = height;
-    current_buffer.cells = malloc(width * height * sizeof(ScreenCell));
-    if (!current_buffer.cells) return 0;
+#define BLANK_GLYPH ' '
+#define BLANK_FG 0xffffffu
+#define BLANK_BG 0x000000u
+
+// Lay a buffer out for width x height cells. The storage is one block:
+// damage bitmaps, fg, bg, then glyphs, each sized by the capacity, and it
+// only grows (with headroom) when the new size does not fit.
+static int alloc_planes(ScreenBuffer *buffer, int width, int height) {
+    size_t cells = (size_t)width * height;
+    if (cells > buffer->cell_capacity || height > buffer->row_capacity) {
+        size_t cell_capacity = cells + cells / 2;
+        int row_capacity = height + height / 2;
+        uint64_t *block = malloc(row_capacity * sizeof(uint64_t) +
+                                 cell_capacity * (2 * sizeof(uint32_t) + 1));
+        if (!block) return 0;
+        free(buffer->damage);
+        buffer->damage = block;
+        buffer->cell_capacity = cell_capacity;
+        buffer->row_capacity = row_capacity;
+    }
+    buffer->width = width;
+    buffer->height = height;
+    buffer->fg = (uint32_t *)(buffer->damage + buffer->row_capacity);
+    buffer->bg = buffer->fg + buffer->cell_capacity;
+    buffer->glyphs = (char *)(buffer->bg + buffer->cell_capacity);
+
+    // A row's 64 damage bits have to span the whole row
+    buffer->damage_shift = 4;
+    while (((width + (1 << buffer->damage_shift) - 1) >> buffer->damage_shift) > 64) {
+        buffer->damage_shift++;
+    }
+    return 1;
+}
+
+static void free_planes(ScreenBuffer *buffer) {
+    free(buffer->damage);
+    buffer->damage = NULL;
+    buffer->fg = buffer->bg = NULL;
+    buffer->glyphs = NULL;
+    buffer->cell_capacity = 0;
+    buffer->row_capacity = 0;
+}
+
+// Reset cells [x0, x1) of row y to the blank cell
+static void blank_span(ScreenBuffer *buffer, int y, int x0, int x1) {
+    size_t offset = (size_t)y * buffer->width;
+    memset(buffer->glyphs + offset + x0, BLANK_GLYPH, x1 - x0);
+    for (int x = x0; x < x1; x++) {
+        buffer->fg[offset + x] = BLANK_FG;
+        buffer->bg[offset + x] = BLANK_BG;
+    }
+}
+
+static inline void mark_cell(ScreenBuffer *buffer, int x, int y) {
+    buffer->damage[y] |= 1ull << (x >> buffer->damage_shift);
+}
 
-    prev_buffer.width = width;
-    prev_buffer.height = height;
-    prev_buffer.cells = malloc(width * height * sizeof(ScreenCell));
-    if (!prev_buffer.cells) {
-        free(current_buffer.cells);
-        return 0;
+// First and one-past-last column covered by a row's damage bits
+static void damage_extent(const ScreenBuffer *buffer, uint64_t bits, int *start, int *end) {
+    *start = __builtin_ctzll(bits) << buffer->damage_shift;
+    *end = (64 - __builtin_clzll(bits)) << buffer->damage_shift;
+    if (*end > buffer->width) *end = buffer->width;
+}
+
+// Blank every frame and force the next flush to repaint everything
+static void reset_contents() {
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        for (int y = 0; y < frames[i].height; y++) {
+            blank_span(&frames[i], y, 0, frames[i].width);
+            frames[i].damage[y] = 0;
+        }
     }
+    buffer_invalidate();
+}
+
+int init_buffer(int width, int height) {
+    if (!encoder_init()) return 0;
 
-    // Initialize previous buffer to a known state
-    for (int i = 0; i < width * height; i++) {
-        prev_buffer.cells[i].character = ' ';
-        prev_buffer.cells[i].dirty = 1; // Force full redraw on first flush
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (!alloc_planes(&frames[i], width, height)) {
+            while (i-- > 0) free_planes(&frames[i]);
+            encoder_destroy();
+            return 0;
+        }
     }
+
+    reset_contents();
     return 1;
 }
 
-void resize_buffer(int new_width, int new_height) {
-    destroy_buffer();
-    init_buffer(new_width, new_height);
+void buffer_invalidate() {
+    // No real cell holds '\0', so every cell differs on the next flush
+    size_t cells = (size_t)prev_buffer->width * prev_buffer->height;
+    memset(prev_buffer->glyphs, '\0', cells);
+    memset(prev_buffer->fg, 0, cells * sizeof(uint32_t));
+    memset(prev_buffer->bg, 0, cells * sizeof(uint32_t));
+    for (int y = 0; y < prev_buffer->height; y++) prev_buffer->damage[y] = ~0ull;
+    encoder_reset_state();
+}
+
+int resize_buffer(int new_width, int new_height) {
+    int old_width = current_buffer->width, old_height = current_buffer->height;
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (!alloc_planes(&frames[i], new_width, new_height)) {
+            // The capacity of the frames done so far only grew, so going
+            // back cannot fail
+            while (i-- > 0) alloc_planes(&frames[i], old_width, old_height);
+            reset_contents();
+            return 0;
+        }
+    }
+    reset_contents();
+    return 1;
 }
 
 void destroy_buffer() {
-    free(current_buffer.cells);
-    free(prev_buffer.cells);
+    for (int i = 0; i < FRAME_COUNT; i++) free_planes(&frames[i]);
+    encoder_destroy();
 }
 
 void buffer_clear() {
-    for (int i = 0; i < current_buffer.width * current_buffer.height; i++) {
-        current_buffer.cells[i].character = ' ';
-        current_buffer.cells[i].fg = (Color){255, 255, 255};
-        current_buffer.cells[i].bg = (Color){0, 0, 0};
+    buffer_erase(current_buffer);
+}
+
+void buffer_erase(ScreenBuffer *buffer) {
+    // Only blocks written since the last clear can hold anything but blanks
+    int block_size = 1 << buffer->damage_shift;
+    for (int y = 0; y < buffer->height; y++) {
+        uint64_t bits = buffer->damage[y];
+        while (bits) {
+            int x0 = __builtin_ctzll(bits) * block_size;
+            if (x0 >= buffer->width) break; // Bits past the row end (full damage)
+            int x1 = x0 + block_size < buffer->width ? x0 + block_size : buffer->width;
+            blank_span(buffer, y, x0, x1);
+            bits &= bits - 1;
+        }
+        buffer->damage[y] = 0;
     }
 }
 
-void buffer_flush() {
-    printf("\x1b[?25l"); // Hide cursor
-
-    Color last_fg = {-1, -1, -1};
-    Color last_bg = {-1, -1, -1};
-
-    for (int y = 0; y < current_buffer.height; y++) {
-        for (int x = 0; x < current_buffer.width; x++) {
-            ScreenCell *current = &current_buffer.cells[y * current_buffer.width + x];
-            ScreenCell *prev = &prev_buffer.cells[y * prev_buffer.width + x];
-
-            // Only redraw if the cell has changed
-            if (current->character != prev->character ||
-                memcmp(&current->fg, &prev->fg, sizeof(Color)) != 0 ||
-                memcmp(&current->bg, &prev->bg, sizeof(Color)) != 0)
-            {
-                // Move cursor to the correct position
-                printf("\x1b[%d;%dH", y + 1, x + 1);
-
-                // Set foreground color if it changed
-                if (memcmp(&current->fg, &last_fg, sizeof(Color)) != 0) {
-                    printf("\x1b[38;2;%d;%d;%dm", current->fg.r, current->fg.g, current->fg.b);
-                    last_fg = current->fg;
-                }
-                // Set background color if it changed
-                if (memcmp(&current->bg, &last_bg, sizeof(Color)) != 0) {
-                    printf("\x1b[48;2;%d;%d;%dm", current->bg.r, current->bg.g, current->bg.b);
-                    last_bg = current->bg;
+int buffer_allocate(ScreenBuffer *buffer, int width, int height) {
+    if (!alloc_planes(buffer, width, height)) return 0;
+    for (int y = 0; y < height; y++) {
+        blank_span(buffer, y, 0, width);
+        buffer->damage[y] = 0;
+    }
+    return 1;
+}
+
+void buffer_free(ScreenBuffer *buffer) {
+    free_planes(buffer);
+}
+
+void buffer_mark_damage(ScreenBuffer *buffer, Rect rect) {
+    int x0 = rect.x < 0 ? 0 : rect.x;
+    int y0 = rect.y < 0 ? 0 : rect.y;
+    int x1 = rect.x + rect.width > buffer->width ? buffer->width : rect.x + rect.width;
+    int y1 = rect.y + rect.height > buffer->height ? buffer->height : rect.y + rect.height;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    int first = x0 >> buffer->damage_shift;
+    int last = (x1 - 1) >> buffer->damage_shift;
+    uint64_t bits = (last == 63 ? ~0ull : (1ull << (last + 1)) - 1) & ~((1ull << first) - 1);
+    for (int y = y0; y < y1; y++) buffer->damage[y] |= bits;
+}
+
+// --- Row diffing ---
+
+// One row of the frame being flushed next to the same row of the last frame
+typedef struct {
+    const char *glyphs, *prev_glyphs;
+    const uint32_t *fg, *prev_fg;
+    const uint32_t *bg, *prev_bg;
+} RowPair;
+
+#define DIFF_BLOCK 16
+
+static int cell_changed(const RowPair *row, int x) {
+    return row->glyphs[x] != row->prev_glyphs[x] ||
+           row->fg[x] != row->prev_fg[x] ||
+           row->bg[x] != row->prev_bg[x];
+}
+
+// Bit i is set when cell x + i changed; cells x .. x + DIFF_BLOCK - 1 must exist
+static unsigned changed_mask(const RowPair *row, int x) {
+#if defined(__AVX2__)
+    __m128i glyphs = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row->glyphs + x)),
+                                    _mm_loadu_si128((const __m128i *)(row->prev_glyphs + x)));
+    __m256i lo = _mm256_and_si256(
+        _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(row->fg + x)),
+                           _mm256_loadu_si256((const __m256i *)(row->prev_fg + x))),
+        _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(row->bg + x)),
+                           _mm256_loadu_si256((const __m256i *)(row->prev_bg + x))));
+    __m256i hi = _mm256_and_si256(
+        _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(row->fg + x + 8)),
+                           _mm256_loadu_si256((const __m256i *)(row->prev_fg + x + 8))),
+        _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(row->bg + x + 8)),
+                           _mm256_loadu_si256((const __m256i *)(row->prev_bg + x + 8))));
+    // Narrow the 32-bit lane masks to bytes; packs works per 128-bit half,
+    // so put the quarters back in cell order before the final pack
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+    __m128i colors = _mm_packs_epi16(_mm256_castsi256_si128(packed),
+                                     _mm256_extracti128_si256(packed, 1));
+    return ~_mm_movemask_epi8(_mm_and_si128(glyphs, colors)) & 0xffff;
+#elif defined(__SSE2__)
+    __m128i glyphs = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row->glyphs + x)),
+                                    _mm_loadu_si128((const __m128i *)(row->prev_glyphs + x)));
+    __m128i same[4];
+    for (int i = 0; i < 4; i++) {
+        same[i] = _mm_and_si128(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(row->fg + x + 4 * i)),
+                            _mm_loadu_si128((const __m128i *)(row->prev_fg + x + 4 * i))),
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(row->bg + x + 4 * i)),
+                            _mm_loadu_si128((const __m128i *)(row->prev_bg + x + 4 * i))));
+    }
+    __m128i colors = _mm_packs_epi16(_mm_packs_epi32(same[0], same[1]),
+                                     _mm_packs_epi32(same[2], same[3]));
+    return ~_mm_movemask_epi8(_mm_and_si128(glyphs, colors)) & 0xffff;
+#else
+    unsigned mask = 0;
+    for (int i = 0; i < DIFF_BLOCK; i++) {
+        if (cell_changed(row, x + i)) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+// First changed cell at or after x, or width if there is none
+static int next_changed(const RowPair *row, int x, int width) {
+    for (; x + DIFF_BLOCK <= width; x += DIFF_BLOCK) {
+        unsigned mask = changed_mask(row, x);
+        if (mask) return x + __builtin_ctz(mask);
+    }
+    for (; x < width; x++) {
+        if (cell_changed(row, x)) return x;
+    }
+    return width;
+}
+
+// Last changed cell in [start, end), or -1 if there is none
+static int last_changed(const RowPair *row, int start, int end) {
+    int x = end;
+    for (; x - DIFF_BLOCK >= start; x -= DIFF_BLOCK) {
+        unsigned mask = changed_mask(row, x - DIFF_BLOCK);
+        if (mask) return x - DIFF_BLOCK + 31 - __builtin_clz(mask);
+    }
+    while (--x >= start) {
+        if (cell_changed(row, x)) return x;
+    }
+    return -1;
+}
+
+// Get the cursor to cell x of a row. Short gaps of already-correct cells are
+// cheaper to print again than to jump over, as long as no color changes.
+static void move_to_cell(const RowPair *row, int x, int y) {
+    int cursor_x = encoder_cursor_x();
+    if (encoder_cursor_y() == y && cursor_x >= 0 && cursor_x < x &&
+        x - cursor_x < encoder_move_cost(x, y)) {
+        int i;
+        for (i = cursor_x; i < x; i++) {
+            if (!encoder_colors_match(row->fg[i], row->bg[i], row->glyphs[i] != ' ', i, y)) break;
+        }
+        if (i == x) {
+            for (i = cursor_x; i < x; i++) encoder_put_char(row->glyphs[i]);
+            return;
+        }
+    }
+    encoder_move_to(x, y);
+}
+
+ScreenBuffer *buffer_encode(ScreenBuffer *frame) {
+    int width = frame->width;
+    // Superseded: the terminal has not taken the last frame yet. Keep
+    // comparing against that one; this frame's cells are simply redrawn.
+    if (!encoder_begin_frame(width, frame->height)) return frame;
+
+    for (int y = 0; y < frame->height; y++) {
+        // Cells can only differ where either frame wrote something
+        uint64_t damage = frame->damage[y] | prev_buffer->damage[y];
+        if (!damage) continue;
+        int start, end;
+        damage_extent(frame, damage, &start, &end);
+
+        size_t offset = (size_t)y * width;
+        RowPair row = {
+            frame->glyphs + offset, prev_buffer->glyphs + offset,
+            frame->fg + offset, prev_buffer->fg + offset,
+            frame->bg + offset, prev_buffer->bg + offset,
+        };
+
+        // Rows whose damaged span is unchanged are skipped here
+        int row_last_changed = last_changed(&row, start, end);
+
+        int x = start;
+        while ((x = next_changed(&row, x, row_last_changed + 1)) <= row_last_changed) {
+            char glyph = row.glyphs[x];
+            uint32_t bg = row.bg[x];
+
+            if (glyph == ' ') {
+                // Blank run: erase it instead of printing spaces when that is cheaper
+                int run_end = x + 1;
+                while (run_end < width && row.glyphs[run_end] == ' ' && row.bg[run_end] == bg) {
+                    run_end++;
                 }
+                int run_last_changed = (run_end - 1 < row_last_changed ? run_end - 1 : row_last_changed);
+                int print_cost = run_last_changed - x + 1;
 
-                putchar(current->character);
+                if (run_end == width && print_cost > 3) {
+                    move_to_cell(&row, x, y);
+                    encoder_set_colors(row.fg[x], bg, 0, x, y);
+                    encoder_erase_line();
+                    break;
+                }
+                // ECH leaves the cursor behind, so count a move past the run too
+                int erase_cost = encoder_erase_cost(run_end - x) + (run_end <= row_last_changed ? 4 : 0);
+                if (erase_cost < print_cost) {
+                    move_to_cell(&row, x, y);
+                    encoder_set_colors(row.fg[x], bg, 0, x, y);
+                    encoder_erase_chars(run_end - x);
+                    x = run_end;
+                    continue;
+                }
             }
+
+            move_to_cell(&row, x, y);
+            encoder_set_colors(row.fg[x], bg, glyph != ' ', x, y);
+            encoder_put_char(glyph);
+            x++;
         }
     }
-    printf("\x1b[0m"); // Reset attributes
-    fflush(stdout);
 
-    // Copy current buffer to previous buffer for the next frame's comparison
-    memcpy(prev_buffer.cells, current_buffer.cells, current_buffer.width * current_buffer.height * sizeof(ScreenCell));
+    // The whole frame goes out in one write(), on the writer thread if it runs
+    encoder_end_frame();
+
+    // The frame just sent becomes the one the next frame is compared with.
+    // The old one is drawn over next; buffer_clear() wipes its damaged blocks.
+    ScreenBuffer *done = prev_buffer;
+    prev_buffer = frame;
+    return done;
 }
 
-void buffer_draw_char(int x, int y, char c, Color fg, Color bg) {
-    if (x >= 0 && x < current_buffer.width && y >= 0 && y < current_buffer.height) {
-        int index = y * current_buffer.width + x;
-        current_buffer.cells[index].character = c;
-        current_buffer.cells[index].fg = fg;
-        current_buffer.cells[index].bg = bg;
+void buffer_flush() {
+    current_buffer = buffer_encode(current_buffer);
+}
+
+void buffer_set_target(ScreenBuffer *frame) {
+    current_buffer = frame;
+}
+
+ScreenBuffer *buffer_spare() {
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        if (&frames[i] != current_buffer && &frames[i] != prev_buffer) return &frames[i];
     }
+    return NULL;
+}
+
+void buffer_draw_char(int x, int y, char c, Color fg, Color bg) {
+    buffer_set_char(current_buffer, x, y, c, fg, bg);
 }
 
 void buffer_draw_text(int x, int y, const char* text, Color fg, Color bg) {
+    buffer_set_text(current_buffer, x, y, text, fg, bg);
+}
+
+void buffer_draw_line(int x0, int y0, int x1, int y1, char ch, Color c) {
+    buffer_set_line(current_buffer, x0, y0, x1, y1, ch, c);
+}
+
+void buffer_set_text(ScreenBuffer *buffer, int x, int y, const char* text, Color fg, Color bg) {
     int i = 0;
     while(text[i] != '\0') {
-        buffer_draw_char(x + i, y, text[i], fg, bg);
+        buffer_set_char(buffer, x + i, y, text[i], fg, bg);
         i++;
     }
 }
 
 // Implementation of Bresenham's line algorithm
-void buffer_draw_line(int x0, int y0, int x1, int y1, char ch, Color c) {
+void buffer_set_line(ScreenBuffer *buffer, int x0, int y0, int x1, int y1, char ch, Color c) {
     int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
     int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
     int err = dx + dy, e2;
 
     for (;;) {
-        buffer_draw_char(x0, y0, ch, c, (Color){0,0,0});
+        buffer_set_char(buffer, x0, y0, ch, c, (Color){0,0,0});
         if (x0 == x1 && y0 == y1) break;
         e2 = 2 * err;
         if (e2 >= dy) { err += dy; x0 += sx; }
@@ -121,7 +409,7 @@ void buffer_draw_line(int x0, int y0, int x1, int y1, char ch, Color c) {
 
 
 ScreenBuffer* get_buffer() {
-    return &current_buffer;
+    return current_buffer;
 }
 
 int buffer_get_width(ScreenBuffer *buffer) {
@@ -135,8 +423,9 @@ int buffer_get_height(ScreenBuffer *buffer) {
 void buffer_set_char(ScreenBuffer *buffer, int x, int y, char character, Color fg, Color bg) {
     if (x >= 0 && x < buffer->width && y >= 0 && y < buffer->height) {
         int index = y * buffer->width + x;
-        buffer->cells[index].character = character;
-        buffer->cells[index].fg = fg;
-        buffer->cells[index].bg = bg;
+        buffer->glyphs[index] = character;
+        buffer->fg[index] = color_pack(fg);
+        buffer->bg[index] = color_pack(bg);
+        mark_cell(buffer, x, y);
     }
 }
@@ -2,42 +2,86 @@
 #define BUFFER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 // Simple RGB color struct
 typedef struct {
     unsigned char r, g, b;
 } Color;
 
-// A single cell on the screen
+// A rectangle of cells
 typedef struct {
-    char character;
-    Color fg;
-    Color bg;
-    int dirty; // Flag to check if this cell needs redrawing
-} ScreenCell;
+    int x, y;
+    int width, height;
+} Rect;
 
-// Screen buffer struct
+// Screen buffer struct. Cells are stored as separate planes so rows can be
+// compared many cells at a time; cell (x, y) lives at index y * width + x.
 typedef struct {
     int width;
     int height;
-    ScreenCell *cells;
+    char *glyphs;  // One character per cell
+    uint32_t *fg;  // Foreground colors, packed as 0x00RRGGBB
+    uint32_t *bg;  // Background colors, packed as 0x00RRGGBB
+    // Per-row damage bitmaps: bit i of damage[y] covers the cells
+    // [i << damage_shift, (i + 1) << damage_shift) of row y. Cells outside
+    // damaged blocks are blank (a space, white on black).
+    uint64_t *damage;
+    int damage_shift;
+    // Size of the allocation behind the planes; resizes that fit reuse it
+    size_t cell_capacity;
+    int row_capacity;
 } ScreenBuffer;
 
+// Pack a color into the 32-bit form used by the buffer planes
+static inline uint32_t color_pack(Color c) {
+    return ((uint32_t)c.r << 16) | ((uint32_t)c.g << 8) | c.b;
+}
+
+// Unpack a 32-bit plane value back into a color
+static inline Color color_unpack(uint32_t packed) {
+    return (Color){(packed >> 16) & 0xff, (packed >> 8) & 0xff, packed & 0xff};
+}
+
 // Initialize the screen buffer system
 int init_buffer(int width, int height);
 
-// Resize the buffers (e.g., on terminal resize)
-void resize_buffer(int new_width, int new_height);
+// Resize the buffers (e.g., on terminal resize). Storage is only reallocated
+// when the new size does not fit in what is already allocated.
+int resize_buffer(int new_width, int new_height);
 
 // Free all resources used by the buffer system
 void destroy_buffer();
 
+// Forget what is on the terminal so the next flush redraws every cell.
+// Call this after something else has written to the screen.
+void buffer_invalidate();
+
 // Clear the current drawing buffer (fill with spaces)
 void buffer_clear();
 
+// Off-screen buffers. buffer_allocate() sets up a zeroed ScreenBuffer, or
+// resizes one, with every cell blank; buffer_erase() is buffer_clear()
+// for it.
+int buffer_allocate(ScreenBuffer *buffer, int width, int height);
+void buffer_erase(ScreenBuffer *buffer);
+void buffer_free(ScreenBuffer *buffer);
+
 // Flush the changes from the current buffer to the terminal
 void buffer_flush();
 
+// Encode a finished frame against the one last sent and hand it to the
+// terminal. Returns the frame that is free to draw into again: the one it
+// replaced, or the frame itself when it was dropped. This only touches the
+// frame and the last sent one, so it can run off the drawing thread.
+ScreenBuffer *buffer_encode(ScreenBuffer *frame);
+
+// Make frame the one buffer_clear(), buffer_draw_* and get_buffer() use
+void buffer_set_target(ScreenBuffer *frame);
+
+// The frame that is neither being drawn nor the last one sent
+ScreenBuffer *buffer_spare();
+
 // Draw a single character to the buffer
 void buffer_draw_char(int x, int y, char c, Color fg, Color bg);
 
@@ -50,8 +94,16 @@ void buffer_draw_line(int x0, int y0, int x1, int y1, char ch, Color c);
 // Get a pointer to the main screen buffer
 ScreenBuffer* get_buffer();
 
+// Mark cells as written. buffer_draw_* and buffer_set_char do this already;
+// modules that write the planes directly must call it for what they touch.
+void buffer_mark_damage(ScreenBuffer *buffer, Rect rect);
+
 int buffer_get_width(ScreenBuffer *buffer);
 int buffer_get_height(ScreenBuffer *buffer);
+
+// The buffer_draw_* calls for an explicit buffer instead of the current one
 void buffer_set_char(ScreenBuffer *buffer, int x, int y, char character, Color fg, Color bg);
+void buffer_set_text(ScreenBuffer *buffer, int x, int y, const char* text, Color fg, Color bg);
+void buffer_set_line(ScreenBuffer *buffer, int x0, int y0, int x1, int y1, char ch, Color c);
 
 #endif // BUFFER_H
\ No newline at end of file
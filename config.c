@@ -45,6 +45,14 @@ static int handler(void* user, const char* section, const char* name, const char
         pconfig->duration = atoi(value);
     } else if (MATCH("slideshow", "fps")) {
         pconfig->fps = atoi(value);
+    } else if (MATCH("slideshow", "colors")) {
+        strncpy(pconfig->colors, value, sizeof(pconfig->colors) - 1);
+    } else if (MATCH("slideshow", "dither")) {
+        pconfig->dither = atoi(value);
+    } else if (MATCH("slideshow", "transition")) {
+        strncpy(pconfig->transition, value, sizeof(pconfig->transition) - 1);
+    } else if (MATCH("slideshow", "transition_time")) {
+        pconfig->transition_time = atof(value);
     } else if (MATCH("slideshow", "palette")) {
         for (int i = 0; i < num_palettes; i++) {
             if (strcmp(palettes[i].name, value) == 0) {
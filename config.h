@@ -15,6 +15,10 @@ typedef struct {
     int duration;
     int fps;
     char palette[32];
+    char colors[16]; // Color profile ("truecolor", "256", "16"); empty = detect
+    int dither;      // Ordered dithering for the 256/16 color profiles
+    char transition[16];    // "none", "fade", "wipe" or "dissolve"; empty = none
+    double transition_time; // Seconds
 } Configuration;
 
 int load_config(Configuration* config);
@@ -0,0 +1,649 @@
+// Define the POSIX source to get write(), poll() and ssize_t declarations
+#define _POSIX_C_SOURCE 200809L
+
+#include "encoder.h"
+#include "terminal.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARENA_INITIAL_SIZE (64 * 1024)
+#define DIGIT_TABLE_SIZE 1000
+
+// Reusable output arena that a whole frame is encoded into
+static char *arena;
+static size_t arena_len;
+static size_t arena_cap;
+
+// The frame being written to the terminal; its buffer is swapped with the
+// arena. With the writer thread running it is written in the background.
+static char *pending;
+static size_t pending_len;
+static size_t pending_sent;
+static size_t pending_cap;
+static int discard_output;
+
+// Writer thread. The lock also guards last_stats, last_dropped and the
+// output times below, which the writer updates and the main thread reads.
+static pthread_t writer_thread;
+static int writer_running;
+static int writer_busy;     // The pending frame is not fully written yet
+static int writer_stopping;
+static int last_dropped;    // The last frame begun was dropped
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static struct timespec encode_start;
+
+// Output time of the frame being encoded and of the one being written, and
+// the frames written since encoder_take_output() last took them
+#define FINISHED_FRAMES 8
+static long frame_id;
+static FrameOutput encoding_output;
+static FrameOutput pending_output;
+static FrameOutput finished[FINISHED_FRAMES];
+static int finished_count;
+
+// Decimal strings for 0..999 so escape sequences need no formatting
+static char digit_text[DIGIT_TABLE_SIZE][3];
+static unsigned char digit_len[DIGIT_TABLE_SIZE];
+
+// Shadow copy of the terminal state, carried across frames
+static int screen_width;
+static int cursor_x = -1, cursor_y = -1;
+static uint32_t cur_fg, cur_bg;
+static int fg_known, bg_known;
+static int needs_hide_cursor;
+
+#define SYNC_BEGIN "\x1b[?2026h"
+#define SYNC_END "\x1b[?2026l"
+static int sync_update;
+
+static FrameStats last_stats;
+
+int encoder_init() {
+    arena = malloc(ARENA_INITIAL_SIZE);
+    if (!arena) return 0;
+    arena_cap = ARENA_INITIAL_SIZE;
+    arena_len = 0;
+
+    for (int n = 0; n < DIGIT_TABLE_SIZE; n++) {
+        if (n >= 100) {
+            digit_text[n][0] = '0' + n / 100;
+            digit_text[n][1] = '0' + (n / 10) % 10;
+            digit_text[n][2] = '0' + n % 10;
+            digit_len[n] = 3;
+        } else if (n >= 10) {
+            digit_text[n][0] = '0' + n / 10;
+            digit_text[n][1] = '0' + n % 10;
+            digit_len[n] = 2;
+        } else {
+            digit_text[n][0] = '0' + n;
+            digit_len[n] = 1;
+        }
+    }
+    encoder_reset_state();
+    return 1;
+}
+
+void encoder_destroy() {
+    encoder_stop_writer();
+    free(arena);
+    free(pending);
+    arena = pending = NULL;
+    arena_len = arena_cap = 0;
+    pending_len = pending_sent = pending_cap = 0;
+}
+
+void encoder_reset_state() {
+    cursor_x = cursor_y = -1;
+    fg_known = bg_known = 0;
+    needs_hide_cursor = 1;
+}
+
+// Make sure at least `extra` more bytes fit in the arena
+static int arena_reserve(size_t extra) {
+    if (arena_len + extra <= arena_cap) return 1;
+    size_t new_cap = arena_cap ? arena_cap : ARENA_INITIAL_SIZE;
+    while (new_cap < arena_len + extra) new_cap *= 2;
+    char *grown = realloc(arena, new_cap);
+    if (!grown) return 0;
+    arena = grown;
+    arena_cap = new_cap;
+    return 1;
+}
+
+static int number_len(unsigned int n) {
+    if (n < DIGIT_TABLE_SIZE) return digit_len[n];
+    int len = 0;
+    while (n > 0) { len++; n /= 10; }
+    return len;
+}
+
+// Append a non-negative number; the caller has reserved space for it
+static void put_number(unsigned int n) {
+    if (n < DIGIT_TABLE_SIZE) {
+        memcpy(arena + arena_len, digit_text[n], digit_len[n]);
+        arena_len += digit_len[n];
+        return;
+    }
+    char tmp[10];
+    int len = 0;
+    while (n > 0) {
+        tmp[len++] = '0' + n % 10;
+        n /= 10;
+    }
+    while (len > 0) arena[arena_len++] = tmp[--len];
+}
+
+static void put_bytes(const char *data, size_t len) {
+    if (!arena_reserve(len)) return;
+    memcpy(arena + arena_len, data, len);
+    arena_len += len;
+}
+
+// Length of "\x1b[<n><final>", where a count of 1 is left implicit
+static int csi_len(int n) {
+    return n == 1 ? 3 : 3 + number_len(n);
+}
+
+static void put_csi(int n, char final) {
+    if (!arena_reserve(3 + 10)) return;
+    arena[arena_len++] = '\x1b';
+    arena[arena_len++] = '[';
+    if (n != 1) put_number(n);
+    arena[arena_len++] = final;
+}
+
+void encoder_set_sync_update(int enabled) {
+    sync_update = enabled;
+}
+
+static double seconds_since(struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Write all of the pending frame
+static void write_pending() {
+    while (pending_sent < pending_len) {
+        struct timespec before;
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        ssize_t written = write(STDOUT_FILENO, pending + pending_sent, pending_len - pending_sent);
+        double elapsed = seconds_since(before);
+
+        pthread_mutex_lock(&writer_lock);
+        pending_output.write_seconds += elapsed;
+        last_stats.syscalls++;
+        pthread_mutex_unlock(&writer_lock);
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Someone else made the terminal non-blocking
+                struct pollfd pfd = {STDOUT_FILENO, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            pending_sent = pending_len; // The terminal went away; drop the rest of the frame
+            break;
+        }
+        pending_sent += written;
+    }
+}
+
+// Report a frame as written; call with writer_lock held. Nobody taking
+// them only costs the oldest.
+static void finish_output(const FrameOutput *output) {
+    if (finished_count == FINISHED_FRAMES) {
+        memmove(finished, finished + 1, (FINISHED_FRAMES - 1) * sizeof(FrameOutput));
+        finished_count--;
+    }
+    finished[finished_count++] = *output;
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&writer_lock);
+    for (;;) {
+        while (!writer_busy && !writer_stopping) pthread_cond_wait(&writer_cond, &writer_lock);
+        if (!writer_busy) break; // Stopping with nothing left to write
+        pthread_mutex_unlock(&writer_lock);
+
+        write_pending();
+
+        pthread_mutex_lock(&writer_lock);
+        finish_output(&pending_output);
+        writer_busy = 0;
+        pthread_cond_broadcast(&writer_cond);
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return NULL;
+}
+
+int encoder_start_writer() {
+    if (writer_running) return 1;
+    writer_stopping = 0;
+    if (term_start_thread(&writer_thread, writer_main, NULL) != 0) return 0;
+    writer_running = 1;
+    return 1;
+}
+
+void encoder_wait_written() {
+    pthread_mutex_lock(&writer_lock);
+    while (writer_busy) pthread_cond_wait(&writer_cond, &writer_lock);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+void encoder_stop_writer() {
+    if (!writer_running) return;
+    pthread_mutex_lock(&writer_lock);
+    writer_stopping = 1;
+    pthread_cond_broadcast(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+    pthread_join(writer_thread, NULL);
+    writer_running = 0;
+}
+
+void encoder_set_discard(int enabled) {
+    discard_output = enabled;
+}
+
+void encoder_set_frame_id(long id) {
+    frame_id = id;
+}
+
+int encoder_begin_frame(int width, int height) {
+    (void)height;
+    pthread_mutex_lock(&writer_lock);
+    if (writer_busy) {
+        // Still sending the last frame: drop this one. The next frame is
+        // diffed against the one in flight, so it picks up these changes.
+        last_stats.dropped++;
+        last_dropped = 1;
+        pthread_mutex_unlock(&writer_lock);
+        return 0;
+    }
+    last_dropped = 0;
+    pthread_mutex_unlock(&writer_lock);
+
+    encoding_output = (FrameOutput){frame_id, 0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &encode_start);
+    arena_len = 0;
+    screen_width = width;
+    if (sync_update) {
+        // Taken back out at the end if the frame turns out to be empty
+        put_bytes(SYNC_BEGIN, sizeof(SYNC_BEGIN) - 1);
+    }
+    if (needs_hide_cursor) {
+        put_bytes("\x1b[?25l", 6);
+        needs_hide_cursor = 0;
+    }
+    return 1;
+}
+
+int encoder_cursor_x() {
+    return cursor_x;
+}
+
+int encoder_cursor_y() {
+    return cursor_y;
+}
+
+// --- Cursor movement cost model ---
+// Candidates are: stay put, CUP (absolute), CUU/CUD + CUF/CUB (relative),
+// and CR followed by a relative move. The cheapest one wins.
+
+enum { MOVE_NONE, MOVE_ABSOLUTE, MOVE_RELATIVE, MOVE_RETURN_RELATIVE };
+
+static int absolute_cost(int x, int y) {
+    if (x == 0 && y == 0) return 3;                       // "\x1b[H"
+    if (x == 0) return 3 + number_len(y + 1);             // "\x1b[<row>H"
+    return 4 + number_len(y + 1) + number_len(x + 1);     // "\x1b[<row>;<col>H"
+}
+
+static int relative_cost(int from, int to) {
+    return from == to ? 0 : csi_len(abs(to - from));
+}
+
+static int plan_move(int x, int y, int *plan) {
+    if (cursor_y == y && cursor_x == x) {
+        *plan = MOVE_NONE;
+        return 0;
+    }
+    int best = absolute_cost(x, y);
+    *plan = MOVE_ABSOLUTE;
+    if (cursor_y < 0) return best;
+
+    int vertical = relative_cost(cursor_y, y);
+    if (cursor_x >= 0) {
+        int cost = vertical + relative_cost(cursor_x, x);
+        if (cost < best) { best = cost; *plan = MOVE_RELATIVE; }
+    }
+    int cost = 1 + vertical + relative_cost(0, x);
+    if (cost < best) { best = cost; *plan = MOVE_RETURN_RELATIVE; }
+    return best;
+}
+
+int encoder_move_cost(int x, int y) {
+    int plan;
+    return plan_move(x, y, &plan);
+}
+
+static void put_relative(int from, int to, char forward, char backward) {
+    if (to > from) put_csi(to - from, forward);
+    else if (to < from) put_csi(from - to, backward);
+}
+
+void encoder_move_to(int x, int y) {
+    int plan;
+    plan_move(x, y, &plan);
+    switch (plan) {
+        case MOVE_NONE:
+            return;
+        case MOVE_ABSOLUTE:
+            if (!arena_reserve(2 + 10 + 1 + 10 + 1)) return;
+            arena[arena_len++] = '\x1b';
+            arena[arena_len++] = '[';
+            if (x != 0 || y != 0) put_number(y + 1);
+            if (x != 0) {
+                arena[arena_len++] = ';';
+                put_number(x + 1);
+            }
+            arena[arena_len++] = 'H';
+            break;
+        case MOVE_RELATIVE:
+            put_relative(cursor_y, y, 'B', 'A');
+            put_relative(cursor_x, x, 'C', 'D');
+            break;
+        case MOVE_RETURN_RELATIVE:
+            put_bytes("\r", 1);
+            put_relative(cursor_y, y, 'B', 'A');
+            put_relative(0, x, 'C', 'D');
+            break;
+    }
+    cursor_x = x;
+    cursor_y = y;
+}
+
+// --- Colors ---
+// Packed RGB colors are turned into a "code" for the active profile: the RGB
+// value itself for truecolor, a palette index for 256/16 colors, or
+// DEFAULT_COLOR for the black background, which is sent as SGR 49. The
+// shadow state holds codes, so colors that quantize alike are not resent.
+
+#define DEFAULT_COLOR 0x80000000u
+#define ANSI16_LUT_BITS 5
+
+static ColorProfile profile = COLOR_TRUECOLOR;
+static int dither_enabled;
+
+// xterm-256: a 6x6x6 cube (indices 16..231) and a 24-step gray ramp (232..255)
+static const unsigned char cube_levels[6] = {0, 95, 135, 175, 215, 255};
+static unsigned char cube_index[256];
+static unsigned char gray_index[256];
+
+// The 16 ANSI colors as xterm draws them, and a 5-bit-per-channel lookup
+// table from RGB to the nearest of them
+static const unsigned char ansi16_rgb[16][3] = {
+    {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+    {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+    {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+    {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255},
+};
+static unsigned char ansi16_lut[1 << (3 * ANSI16_LUT_BITS)];
+
+// 4x4 Bayer matrix for ordered dithering
+static const unsigned char bayer4[4][4] = {
+    {0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5},
+};
+
+static void build_color_tables() {
+    static int built = 0;
+    if (built) return;
+    built = 1;
+
+    for (int v = 0; v < 256; v++) {
+        int best = 0;
+        for (int i = 1; i < 6; i++) {
+            if (abs(v - cube_levels[i]) < abs(v - cube_levels[best])) best = i;
+        }
+        cube_index[v] = best;
+        int gray = (v - 8 + 5) / 10;
+        gray_index[v] = gray < 0 ? 0 : (gray > 23 ? 23 : gray);
+    }
+
+    int levels = 1 << ANSI16_LUT_BITS;
+    int half_step = (256 / levels) / 2;
+    for (int r = 0; r < levels; r++) {
+        for (int g = 0; g < levels; g++) {
+            for (int b = 0; b < levels; b++) {
+                // Match the center of each bucket
+                int cr = r * 256 / levels + half_step;
+                int cg = g * 256 / levels + half_step;
+                int cb = b * 256 / levels + half_step;
+                int best = 0, best_dist = 1 << 30;
+                for (int i = 0; i < 16; i++) {
+                    int dr = cr - ansi16_rgb[i][0], dg = cg - ansi16_rgb[i][1], db = cb - ansi16_rgb[i][2];
+                    int dist = dr * dr + dg * dg + db * db;
+                    if (dist < best_dist) { best_dist = dist; best = i; }
+                }
+                ansi16_lut[(r << (2 * ANSI16_LUT_BITS)) | (g << ANSI16_LUT_BITS) | b] = best;
+            }
+        }
+    }
+}
+
+void encoder_set_profile(ColorProfile new_profile, int dither) {
+    profile = new_profile;
+    dither_enabled = dither && new_profile != COLOR_TRUECOLOR;
+    if (profile != COLOR_TRUECOLOR) build_color_tables();
+    fg_known = bg_known = 0;
+}
+
+ColorProfile encoder_detect_profile() {
+    const char *colorterm = getenv("COLORTERM");
+    if (colorterm && (strcmp(colorterm, "truecolor") == 0 || strcmp(colorterm, "24bit") == 0)) {
+        return COLOR_TRUECOLOR;
+    }
+    const char *term = getenv("TERM");
+    if (term && strstr(term, "256color")) return COLOR_256;
+    return COLOR_16;
+}
+
+int encoder_parse_profile(const char *name, ColorProfile *out) {
+    if (strcmp(name, "truecolor") == 0 || strcmp(name, "24bit") == 0) *out = COLOR_TRUECOLOR;
+    else if (strcmp(name, "256") == 0) *out = COLOR_256;
+    else if (strcmp(name, "16") == 0) *out = COLOR_16;
+    else return 0;
+    return 1;
+}
+
+static int clamp_channel(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static uint32_t color_code(uint32_t rgb, int is_bg, int x, int y) {
+    if (is_bg && rgb == 0) return DEFAULT_COLOR;
+    if (profile == COLOR_TRUECOLOR) return rgb;
+
+    int r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+    if (dither_enabled) {
+        // Spread the offset over roughly one quantization step
+        int step = profile == COLOR_256 ? 40 : 128;
+        int offset = (bayer4[y & 3][x & 3] * 2 - 15) * step / 32;
+        r = clamp_channel(r + offset);
+        g = clamp_channel(g + offset);
+        b = clamp_channel(b + offset);
+    }
+
+    if (profile == COLOR_16) {
+        return ansi16_lut[((r >> (8 - ANSI16_LUT_BITS)) << (2 * ANSI16_LUT_BITS)) |
+                          ((g >> (8 - ANSI16_LUT_BITS)) << ANSI16_LUT_BITS) |
+                          (b >> (8 - ANSI16_LUT_BITS))];
+    }
+
+    // 256 colors: the nearer of the cube entry and the gray ramp entry
+    int ri = cube_index[r], gi = cube_index[g], bi = cube_index[b];
+    int dr = r - cube_levels[ri], dg = g - cube_levels[gi], db = b - cube_levels[bi];
+    int cube_dist = dr * dr + dg * dg + db * db;
+    int gray = gray_index[(r + g + b) / 3];
+    int level = 8 + 10 * gray;
+    int gray_dist = (r - level) * (r - level) + (g - level) * (g - level) + (b - level) * (b - level);
+    if (gray_dist < cube_dist) return 232 + gray;
+    return 16 + 36 * ri + 6 * gi + bi;
+}
+
+int encoder_colors_match(uint32_t fg, uint32_t bg, int need_fg, int x, int y) {
+    if (!bg_known || color_code(bg, 1, x, y) != cur_bg) return 0;
+    return !need_fg || (fg_known && color_code(fg, 0, x, y) == cur_fg);
+}
+
+// Append the SGR parameters for a color code ("38;2;r;g;b", "38;5;n",
+// "3n"/"9n" or "39", and the 4x/10x forms for the background); the caller has
+// reserved space for it
+static void put_color(int is_bg, uint32_t code) {
+    if (code == DEFAULT_COLOR) {
+        arena[arena_len++] = is_bg ? '4' : '3';
+        arena[arena_len++] = '9';
+    } else if (profile == COLOR_TRUECOLOR) {
+        memcpy(arena + arena_len, is_bg ? "48;2;" : "38;2;", 5);
+        arena_len += 5;
+        put_number((code >> 16) & 0xff);
+        arena[arena_len++] = ';';
+        put_number((code >> 8) & 0xff);
+        arena[arena_len++] = ';';
+        put_number(code & 0xff);
+    } else if (profile == COLOR_256) {
+        memcpy(arena + arena_len, is_bg ? "48;5;" : "38;5;", 5);
+        arena_len += 5;
+        put_number(code);
+    } else if (code < 8) {
+        put_number((is_bg ? 40 : 30) + code);
+    } else {
+        put_number((is_bg ? 100 : 90) + code - 8);
+    }
+}
+
+void encoder_set_colors(uint32_t fg, uint32_t bg, int need_fg, int x, int y) {
+    uint32_t fg_code = need_fg ? color_code(fg, 0, x, y) : 0;
+    uint32_t bg_code = color_code(bg, 1, x, y);
+    int send_fg = need_fg && !(fg_known && fg_code == cur_fg);
+    int send_bg = !(bg_known && bg_code == cur_bg);
+    if (!send_fg && !send_bg) return;
+
+    // Both colors share one SGR sequence when they change together
+    if (!arena_reserve(2 + 2 * 16 + 2)) return;
+    arena[arena_len++] = '\x1b';
+    arena[arena_len++] = '[';
+    if (send_fg) {
+        put_color(0, fg_code);
+        cur_fg = fg_code;
+        fg_known = 1;
+    }
+    if (send_bg) {
+        if (send_fg) arena[arena_len++] = ';';
+        put_color(1, bg_code);
+        cur_bg = bg_code;
+        bg_known = 1;
+    }
+    arena[arena_len++] = 'm';
+}
+
+void encoder_put_char(char c) {
+    if (!arena_reserve(1)) return;
+    arena[arena_len++] = c;
+    if (cursor_x >= 0) {
+        cursor_x++;
+        // Writing the last column leaves the cursor in the pending-wrap state,
+        // where terminals disagree on what a relative move does
+        if (cursor_x >= screen_width) cursor_x = -1;
+    }
+}
+
+// --- Erasing ---
+
+int encoder_erase_cost(int n) {
+    return csi_len(n);
+}
+
+void encoder_erase_chars(int n) {
+    put_csi(n, 'X');
+}
+
+void encoder_erase_line() {
+    put_bytes("\x1b[K", 3);
+}
+
+void encoder_end_frame() {
+    if (sync_update) {
+        if (arena_len == sizeof(SYNC_BEGIN) - 1) arena_len = 0;
+        else put_bytes(SYNC_END, sizeof(SYNC_END) - 1);
+    }
+
+    encoding_output.encode_seconds = seconds_since(encode_start);
+    pthread_mutex_lock(&writer_lock);
+    last_stats.bytes = arena_len;
+    last_stats.syscalls = 0;
+    if (discard_output) finish_output(&encoding_output);
+    else pending_output = encoding_output; // The writer is idle
+    pthread_mutex_unlock(&writer_lock);
+    if (discard_output) {
+        arena_len = 0;
+        return;
+    }
+
+    // Hand the arena over as the pending frame and reuse the old one. The
+    // writer is idle here: encoder_begin_frame() checked.
+    char *sent = pending;
+    size_t sent_cap = pending_cap;
+    pending = arena;
+    pending_cap = arena_cap;
+    pending_len = arena_len;
+    pending_sent = 0;
+    arena = sent;
+    arena_cap = sent_cap;
+    arena_len = 0;
+
+    if (writer_running) {
+        pthread_mutex_lock(&writer_lock);
+        writer_busy = 1;
+        pthread_cond_broadcast(&writer_cond);
+        pthread_mutex_unlock(&writer_lock);
+    } else {
+        write_pending();
+        pthread_mutex_lock(&writer_lock);
+        finish_output(&pending_output);
+        pthread_mutex_unlock(&writer_lock);
+    }
+}
+
+FrameStats encoder_get_stats() {
+    pthread_mutex_lock(&writer_lock);
+    FrameStats stats = last_stats;
+    pthread_mutex_unlock(&writer_lock);
+    return stats;
+}
+
+int encoder_take_output(FrameOutput *out) {
+    pthread_mutex_lock(&writer_lock);
+    int taken = finished_count > 0;
+    if (taken) {
+        *out = finished[0];
+        memmove(finished, finished + 1, (finished_count - 1) * sizeof(FrameOutput));
+        finished_count--;
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return taken;
+}
+
+int encoder_last_frame_dropped() {
+    pthread_mutex_lock(&writer_lock);
+    int dropped = last_dropped;
+    pthread_mutex_unlock(&writer_lock);
+    return dropped;
+}
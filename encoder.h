@@ -0,0 +1,118 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stddef.h>
+#include "buffer.h"
+
+// What the last frame cost to send to the terminal
+typedef struct {
+    size_t bytes;  // Bytes written for the frame
+    int syscalls;  // Number of write() calls it took
+    int dropped;   // Frames dropped so far because the terminal was busy
+} FrameStats;
+
+// What encoding and writing one frame took. The output threads finish a
+// frame well after it was drawn, so this carries the frame's id along.
+typedef struct {
+    long frame;            // The id from encoder_set_frame_id()
+    double encode_seconds;
+    double write_seconds;  // Time spent in write()
+} FrameOutput;
+
+// How colors are sent to the terminal
+typedef enum {
+    COLOR_TRUECOLOR,  // 24-bit SGR 38;2 / 48;2
+    COLOR_256,        // xterm 256-color palette
+    COLOR_16,         // The 16 ANSI colors
+} ColorProfile;
+
+// Allocate the output arena and build the digit lookup tables
+int encoder_init();
+
+// Free the output arena
+void encoder_destroy();
+
+// Forget what we know about the terminal (cursor, colors); the next frame
+// re-establishes it. Call this after anything else writes to the terminal.
+void encoder_reset_state();
+
+// Choose the color profile; dithering only applies to the palette profiles
+void encoder_set_profile(ColorProfile profile, int dither);
+
+// Guess the best profile from $COLORTERM and $TERM
+ColorProfile encoder_detect_profile();
+
+// Parse "truecolor", "256" or "16"; returns 0 for anything else
+int encoder_parse_profile(const char *name, ColorProfile *out);
+
+// Wrap each frame in begin/end synchronized update (mode 2026) so the
+// terminal presents it at once
+void encoder_set_sync_update(int enabled);
+
+// Write frames from a background thread. While it is still writing one
+// frame, the next is dropped (encoder_begin_frame() returns 0).
+int encoder_start_writer();
+
+// Wait until the frame in flight has been written. Do this before anything
+// else writes to the terminal.
+void encoder_wait_written();
+
+// Finish the frame in flight and stop the writer thread
+void encoder_stop_writer();
+
+// Encode frames but throw them away instead of writing them (headless runs)
+void encoder_set_discard(int enabled);
+
+// Tag the frames encoded from now on with id (from the thread that encodes)
+void encoder_set_frame_id(long id);
+
+// Start encoding a new frame for a screen of the given size. Returns 0, and
+// the frame must be skipped, while the previous one is still being written.
+int encoder_begin_frame(int width, int height);
+
+// Where the terminal cursor is (-1 when unknown)
+int encoder_cursor_x();
+int encoder_cursor_y();
+
+// Bytes the cheapest cursor movement to (x, y) would take
+int encoder_move_cost(int x, int y);
+
+// Move the cursor to (x, y) using the cheapest sequence (0-based coordinates)
+void encoder_move_to(int x, int y);
+
+// Whether cell (x, y) could be printed without changing the current colors.
+// Colors are packed as in the buffer planes; blank cells (need_fg == 0)
+// only care about the background.
+int encoder_colors_match(uint32_t fg, uint32_t bg, int need_fg, int x, int y);
+
+// Switch to the colors of cell (x, y), sending only the parts that change
+// once quantized to the active profile
+void encoder_set_colors(uint32_t fg, uint32_t bg, int need_fg, int x, int y);
+
+// Print a character at the cursor and advance it
+void encoder_put_char(char c);
+
+// Bytes an ECH of n cells would take
+int encoder_erase_cost(int n);
+
+// Blank n cells (ECH) / the rest of the line (EL) with the current background.
+// The cursor does not move.
+void encoder_erase_chars(int n);
+void encoder_erase_line();
+
+// Send the encoded frame to the terminal in a single write, on the writer
+// thread if it is running
+void encoder_end_frame();
+
+// Get the byte and syscall cost of the last frame
+FrameStats encoder_get_stats();
+
+// Take the output time of the oldest frame written since the last call.
+// Returns 0 when there is none; dropped frames are never reported.
+int encoder_take_output(FrameOutput *out);
+
+// Whether the last frame was dropped, so its changes have yet to reach the
+// terminal with a later one
+int encoder_last_frame_dropped();
+
+#endif // ENCODER_H
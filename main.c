@@ -6,7 +6,7 @@
  * user input, and managing the art modules.
  */
 
-// Define the POSIX source to get clock_gettime and nanosleep declarations
+// Define the POSIX source to get clock_gettime declarations
 #define _POSIX_C_SOURCE 199309L
 
 #include <stdio.h>
@@ -15,59 +15,108 @@
 #include <time.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <curl/curl.h>
 
 #include "terminal.h"
 #include "buffer.h"
+#include "encoder.h"
+#include "stats.h"
+#include "pacing.h"
+#include "threadpool.h"
+#include "pipeline.h"
+#include "warmup.h"
+#include "transition.h"
 #include "art.h"
 #include "art_image.h"
 #include "config.h"
 #include "art_mtg.h"
 #include "art_mtg_sixel.h"
 
+// How long the terminal size has to stay put before we resize (window drags
+// fire a burst of SIGWINCHs)
+#define RESIZE_SETTLE_SECONDS 0.15
+
 // --- Main Application State ---
 static int slide_duration = 20;
 static int target_fps = 25;
 static int show_info_hud = 0;
 static int is_paused = 0;
+static TransitionKind transition_kind = TRANSITION_NONE;
+static double transition_seconds = 1.0;
 
 // --- Art Module Registry ---
 // Forward declarations of the art module getters
-ArtModule get_mandelbrot_module();
-ArtModule get_plasma_module();
-ArtModule get_starfield_module();
-ArtModule get_matrix_module();
-ArtModule get_gameoflife_module();
-ArtModule get_cube_module();
-ArtModule get_clock_module();
+ArtModuleV2 get_mandelbrot_module();
+ArtModuleV2 get_plasma_module();
+ArtModuleV2 get_starfield_module();
+ArtModuleV2 get_matrix_module();
+ArtModuleV2 get_gameoflife_module();
+ArtModuleV2 get_cube_module();
+ArtModuleV2 get_clock_module();
 ArtModule get_image_module();
-ArtModule get_mtg_module();
+ArtModuleV2 get_mtg_module();
 ArtModule get_mtg_sixel_module();
 
 // We declare the array here, but initialize it in main()
-static ArtModule art_modules[9];
-const int num_art_modules = sizeof(art_modules) / sizeof(ArtModule);
+static ArtModuleV2 art_modules[9];
+const int num_art_modules = sizeof(art_modules) / sizeof(ArtModuleV2);
+// Modules still on the version 1 interface, wrapped in art_modules
+static ArtModule image_module;
+static ArtModule mtg_sixel_module;
 
 // --- Function Prototypes ---
 void print_usage(const char *prog_name);
 void list_modules();
 void shuffle_modules();
-void populate_modules();
-void draw_hud(double time_left, int current_module_index, double fps);
-int handle_input(int current_index);
+void populate_modules(int probe_sixel);
+void draw_hud(double time_left, int current_module_index);
+int handle_input(int key, int current_index, ArtInstance *instance);
+int module_is_sixel(const ArtModuleV2 *module);
+void apply_resize(ArtInstance *instance);
+void arm_timer(int fd, struct timespec when, int absolute);
+void charge_output();
+struct timespec timespec_after(struct timespec base, double seconds);
+int run_headless(int module_index, int width, int height, int frames);
+
+// Long-only options
+enum {
+    OPT_HEADLESS = 256,
+    OPT_SIZE,
+    OPT_FRAMES,
+    OPT_PACING,
+    OPT_TRANSITION,
+    OPT_TRANSITION_TIME,
+};
 
 int main(int argc, char **argv) {
-    Configuration config = { .duration = 20, .fps = 25 };
+    Configuration config = { .duration = 20, .fps = 25, .transition_time = 1.0 };
     strcpy(config.palette, "default");
     load_config(&config);
 
     slide_duration = config.duration;
     target_fps = config.fps;
+    transition_seconds = config.transition_time;
+    if (config.transition[0] && !transition_parse(config.transition, &transition_kind)) {
+        fprintf(stderr, "Unknown transition '%s' in the config file.\n", config.transition);
+        return 1;
+    }
 
-    // Populate the art modules array now that we are in a function
-    populate_modules();
-
+    const char *start_with_name = NULL;
     int start_with_index = 0;
     int randomize_order = 0;
+    int list_only = 0;
+
+    // Headless benchmark settings
+    int headless = 0;
+    int headless_width = 80, headless_height = 24;
+    int headless_frames = 500;
+
+    PacingPolicy pacing_policy = PACING_SKIP;
+    int threads = 0; // One per CPU
 
     // --- Command-line Argument Parsing ---
     int opt;
@@ -76,38 +125,112 @@ int main(int argc, char **argv) {
         {"fps",         required_argument, 0, 'f'},
         {"list",        no_argument,       0, 'l'},
         {"start-with",  required_argument, 0, 's'},
+        {"module",      required_argument, 0, 's'},
         {"random",      no_argument,       0, 'r'},
         {"image",       required_argument, 0, 'i'},
         {"palette",     required_argument, 0, 'p'},
         {"single",      no_argument,       0, 'S'},
+        {"colors",      required_argument, 0, 'c'},
+        {"dither",      no_argument,       0, 'D'},
+        {"threads",     required_argument, 0, 't'},
+        {"headless",    no_argument,       0, OPT_HEADLESS},
+        {"size",        required_argument, 0, OPT_SIZE},
+        {"frames",      required_argument, 0, OPT_FRAMES},
+        {"pacing",      required_argument, 0, OPT_PACING},
+        {"transition",  required_argument, 0, OPT_TRANSITION},
+        {"transition-time", required_argument, 0, OPT_TRANSITION_TIME},
         {"help",        no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
 
     int single_mode = 0;
 
-    while ((opt = getopt_long(argc, argv, "d:f:ls:ri:p:Sh", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:f:ls:ri:p:Sc:Dt:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd': slide_duration = atoi(optarg); break;
             case 'f': target_fps = atoi(optarg); break;
-            case 'l': list_modules(); return 0;
-            case 's':
-                for(int i = 0; i < num_art_modules; i++) {
-                    if (strcmp(art_modules[i].name, optarg) == 0) {
-                        start_with_index = i;
-                        break;
-                    }
-                }
-                break;
+            case 'l': list_only = 1; break;
+            case 's': start_with_name = optarg; break;
             case 'i': image_set_path(optarg); break;
             case 'p': strncpy(config.palette, optarg, sizeof(config.palette) - 1); break;
             case 'S': single_mode = 1; break;
+            case 'c': strncpy(config.colors, optarg, sizeof(config.colors) - 1); break;
+            case 'D': config.dither = 1; break;
+            case 't': threads = atoi(optarg); break;
             case 'r': randomize_order = 1; break;
+            case OPT_HEADLESS: headless = 1; break;
+            case OPT_SIZE:
+                if (sscanf(optarg, "%dx%d", &headless_width, &headless_height) != 2 ||
+                    headless_width <= 0 || headless_height <= 0) {
+                    fprintf(stderr, "Invalid size '%s' (use WIDTHxHEIGHT).\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_FRAMES: headless_frames = atoi(optarg); break;
+            case OPT_PACING:
+                if (!pacing_parse_policy(optarg, &pacing_policy)) {
+                    fprintf(stderr, "Unknown pacing policy '%s' (use skip or catch-up).\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_TRANSITION:
+                if (!transition_parse(optarg, &transition_kind)) {
+                    fprintf(stderr, "Unknown transition '%s' (use none, fade, wipe or dissolve).\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_TRANSITION_TIME: transition_seconds = atof(optarg); break;
             case 'h': print_usage(argv[0]); return 0;
             default: print_usage(argv[0]); return 1;
         }
     }
 
+    // Populate the art modules array; a headless run never probes the terminal
+    populate_modules(!headless);
+    if (list_only) {
+        list_modules();
+        return 0;
+    }
+    if (start_with_name) {
+        start_with_index = -1;
+        for (int i = 0; i < num_art_modules; i++) {
+            if (strcmp(art_modules[i].name, start_with_name) == 0) {
+                start_with_index = i;
+                break;
+            }
+        }
+        if (start_with_index < 0) {
+            if (headless) {
+                fprintf(stderr, "Unknown module '%s' (see --list).\n", start_with_name);
+                return 1;
+            }
+            start_with_index = 0;
+        }
+    }
+
+    ColorProfile color_profile = encoder_detect_profile();
+    if (config.colors[0] && !encoder_parse_profile(config.colors, &color_profile)) {
+        fprintf(stderr, "Unknown color profile '%s' (use truecolor, 256 or 16).\n", config.colors);
+        return 1;
+    }
+    encoder_set_profile(color_profile, config.dither);
+
+    // libcurl's global state is not thread-safe to set up or tear down, so
+    // it is done once here, before any thread starts, rather than by each
+    // mtg instance
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (!threadpool_init(threads)) {
+        curl_global_cleanup();
+        fprintf(stderr, "Failed to start worker threads.\n");
+        return 1;
+    }
+    if (headless) {
+        int status = run_headless(start_with_index, headless_width, headless_height, headless_frames);
+        threadpool_destroy();
+        curl_global_cleanup();
+        return status;
+    }
+
     srand(time(NULL));
     if (randomize_order) {
         shuffle_modules();
@@ -115,121 +238,390 @@ int main(int argc, char **argv) {
 
     // --- Terminal and Buffer Setup ---
     setup_terminal();
+    encoder_set_sync_update(term_supports_sync_update());
     if (!init_buffer(term_get_width(), term_get_height())) {
         cleanup_terminal();
         fprintf(stderr, "Failed to initialize screen buffer.\n");
         return 1;
     }
+    // Encode and write on their own threads; a slow terminal drops frames
+    // instead of stalling the loop
+    if (!pipeline_start()) {
+        destroy_buffer();
+        cleanup_terminal();
+        fprintf(stderr, "Failed to start the output threads.\n");
+        return 1;
+    }
 
     // --- Main Loop ---
+    // Everything the loop waits for goes through one epoll set: keys, signals
+    // (resize, quit), the frame clock and the resize debounce timer
+    int frame_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int resize_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (frame_timer < 0 || resize_timer < 0 || epoll_fd < 0 || term_signal_fd() < 0) {
+        pipeline_stop();
+        destroy_buffer();
+        cleanup_terminal();
+        fprintf(stderr, "Failed to set up the event loop.\n");
+        return 1;
+    }
+    int watched[] = {STDIN_FILENO, term_signal_fd(), frame_timer, resize_timer};
+    for (size_t i = 0; i < sizeof(watched) / sizeof(watched[0]); i++) {
+        struct epoll_event event = {.events = EPOLLIN, .data.fd = watched[i]};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched[i], &event);
+    }
+
     int current_module_index = start_with_index;
-    struct timespec last_frame_time;
-    clock_gettime(CLOCK_MONOTONIC, &last_frame_time);
+    pacing_start(target_fps, pacing_policy);
+
+    // The slide being transitioned away from, and the off-screen frames the
+    // two slides are drawn into while it lasts
+    ArtInstance outgoing;
+    int has_outgoing = 0;
+    double outgoing_time = 0; // Its slide time when it was replaced
+    ScreenBuffer from_frame = {0}, to_frame = {0};
 
     while (1) {
-        ArtModule *current_module = &art_modules[current_module_index];
-        int is_sixel_module = (strcmp(current_module->name, "image") == 0 || strcmp(current_module->name, "mtg-sixel") == 0);
+        ArtModuleV2 *current_module = &art_modules[current_module_index];
+        int is_sixel_module = module_is_sixel(current_module);
         int is_static_sixel = is_sixel_module; // For now, treat both as static
         int drawn = 0;
 
-        if (current_module->init) {
-            current_module->init(term_get_width(), term_get_height(), get_current_palette());
+        // The buffer size, not the terminal's: a resize may still be settling
+        int width = get_buffer()->width, height = get_buffer()->height;
+        ArtInstance instance;
+        if (!warmup_take(current_module, &instance)) {
+            art_instance_create(&instance, current_module, width, height, get_current_palette());
+        } else if (instance.frame.width != width || instance.frame.height != height) {
+            // Prepared before a resize
+            art_instance_resize(&instance, width, height, get_current_palette());
+        }
+        // Get the slide after this one ready while this one is on screen
+        if (!single_mode) {
+            warmup_start(&art_modules[(current_module_index + 1) % num_art_modules],
+                         width, height, get_current_palette());
         }
 
         struct timespec slide_start_time;
         clock_gettime(CLOCK_MONOTONIC, &slide_start_time);
+        pacing_reset();
+        arm_timer(frame_timer, pacing_deadline(), 1);
 
+        int next_index = current_module_index;
+        int input_ready = 1; // Keys left over from the last slide come first
+        int idle = 0;        // Sleeping until the module's next change, off the frame schedule
         while (1) {
-            if (is_static_sixel && drawn) {
-                // For static sixel images, we've drawn it once. Now just wait for input.
-                int new_index = handle_input(current_module_index);
-                if (new_index == -2) goto cleanup; // Quit
-                if (new_index != current_module_index) {
-                    current_module_index = new_index;
-                    break;
+            struct epoll_event events[8];
+            int count = epoll_wait(epoll_fd, events, 8, term_input_timeout());
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                goto cleanup;
+            }
+            if (count == 0) input_ready = 1; // A held-back Escape key is due
+
+            int frame_due = 0;
+            int frame_tick = 0;
+            for (int i = 0; i < count; i++) {
+                int fd = events[i].data.fd;
+                uint64_t expirations;
+                if (fd == STDIN_FILENO) {
+                    if (!term_read_input()) {
+                        // End of input or a read error: stop watching it
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+                    }
+                    input_ready = 1;
+                } else if (fd == term_signal_fd()) {
+                    if (term_handle_signals()) goto cleanup; // SIGINT / SIGTERM
+                    if (term_has_resized()) {
+                        // Debounce resizes: wait until the size has settled
+                        struct timespec settle = {0, (long)(RESIZE_SETTLE_SECONDS * 1e9)};
+                        arm_timer(resize_timer, settle, 0);
+                    }
+                } else if (fd == resize_timer) {
+                    if (read(resize_timer, &expirations, sizeof(expirations)) < 0) continue;
+                    if (term_get_width() != get_buffer()->width || term_get_height() != get_buffer()->height) {
+                        apply_resize(&instance);
+                        if (has_outgoing) {
+                            art_instance_resize(&outgoing, get_buffer()->width, get_buffer()->height,
+                                                get_current_palette());
+                        }
+                        drawn = 0; // Redraw after resize
+                        frame_due = 1;
+                    }
+                } else if (fd == frame_timer) {
+                    if (read(frame_timer, &expirations, sizeof(expirations)) < 0) continue;
+                    frame_due = frame_tick = 1;
                 }
-                // Sleep to prevent busy-waiting
-                struct timespec sleep_time = {0, 10000000}; // 10ms
-                nanosleep(&sleep_time, NULL);
-                continue;
             }
 
-            // Timing
+            if (input_ready) {
+                struct timespec input_start, input_end;
+                clock_gettime(CLOCK_MONOTONIC, &input_start);
+                int key;
+                while (next_index == current_module_index && (key = term_get_key()) != -1) {
+                    next_index = handle_input(key, current_module_index, &instance);
+                    frame_due = 1; // Show the effect of the key right away
+                }
+                input_ready = 0;
+                clock_gettime(CLOCK_MONOTONIC, &input_end);
+                stats_add(PHASE_INPUT, (input_end.tv_sec - input_start.tv_sec) +
+                                       (input_end.tv_nsec - input_start.tv_nsec) / 1e9);
+                if (next_index == -2) goto cleanup; // Quit
+                if (next_index != current_module_index) break;
+            }
+
+            // A static sixel image is drawn once; after that only input and
+            // resizes wake us up
+            if (!frame_due || (is_static_sixel && drawn)) continue;
+
             struct timespec current_time;
             clock_gettime(CLOCK_MONOTONIC, &current_time);
             double elapsed_slide_seconds = (current_time.tv_sec - slide_start_time.tv_sec) +
                                            (current_time.tv_nsec - slide_start_time.tv_nsec) / 1e9;
-            double elapsed_frame_seconds = (current_time.tv_sec - last_frame_time.tv_sec) +
-                                           (current_time.tv_nsec - last_frame_time.tv_nsec) / 1e9;
-
-            if (term_has_resized()) {
-                resize_buffer(term_get_width(), term_get_height());
-                if (current_module->destroy) current_module->destroy();
-                if (current_module->init) current_module->init(term_get_width(), term_get_height(), get_current_palette());
-                drawn = 0; // Redraw after resize
-            }
 
-            int new_index = handle_input(current_module_index);
-            if (new_index == -2) goto cleanup; // Quit
-            if (new_index != current_module_index) {
-                current_module_index = new_index;
-                break;
+            stats_begin_frame(current_module->name);
+
+            // The last slide keeps running underneath until the transition is over
+            int transitioning = has_outgoing && elapsed_slide_seconds < transition_seconds;
+            if (has_outgoing && !transitioning) {
+                art_instance_destroy(&outgoing);
+                has_outgoing = 0;
             }
 
             // Update and Draw
             if (!is_paused) {
                 double progress = elapsed_slide_seconds / slide_duration;
-                if (current_module->update) {
-                    current_module->update(progress, elapsed_slide_seconds);
+                art_instance_update(&instance, progress, elapsed_slide_seconds);
+                if (transitioning) {
+                    double time = outgoing_time + elapsed_slide_seconds;
+                    art_instance_update(&outgoing, time / slide_duration, time);
                 }
             }
+            stats_mark(PHASE_UPDATE);
 
             if (!is_sixel_module) {
                 buffer_clear();
             }
 
-            if (current_module->draw) {
-                current_module->draw(get_buffer(), get_current_palette());
+            ScreenBuffer *screen = get_buffer();
+            if (transitioning &&
+                (from_frame.width != screen->width || from_frame.height != screen->height ||
+                 to_frame.width != screen->width || to_frame.height != screen->height) &&
+                (!buffer_allocate(&from_frame, screen->width, screen->height) ||
+                 !buffer_allocate(&to_frame, screen->width, screen->height))) {
+                // No room to draw both slides: cut straight to the new one
+                art_instance_destroy(&outgoing);
+                has_outgoing = 0;
+                transitioning = 0;
+            }
+
+            if (transitioning) {
+                // Draw both slides off-screen and mix them onto the screen
+                buffer_erase(&from_frame);
+                art_instance_draw(&outgoing, &from_frame, get_current_palette());
+                buffer_erase(&to_frame);
+                art_instance_draw(&instance, &to_frame, get_current_palette());
+                transition_compose(transition_kind, elapsed_slide_seconds / transition_seconds,
+                                   &from_frame, &to_frame, screen);
+            } else if (current_module->draw) {
+                if (is_sixel_module) {
+                    // Sixel modules (and their children) write straight to the
+                    // terminal; let the frames in flight get there first
+                    pipeline_drain();
+                }
+                art_instance_draw(&instance, get_buffer(), get_current_palette());
                 if (is_static_sixel) {
                     drawn = 1;
                 }
+                if (is_sixel_module) {
+                    // The module wrote to the terminal behind the encoder's back
+                    buffer_invalidate();
+                }
             }
 
             if (show_info_hud) {
-                draw_hud(slide_duration - elapsed_slide_seconds, current_module_index, 1.0/elapsed_frame_seconds);
+                draw_hud(slide_duration - elapsed_slide_seconds, current_module_index);
             }
+            stats_mark(PHASE_DRAW);
 
+            // Encoding and writing happen on the output threads while the next
+            // frame is drawn. Waiting for them is not charged; the time they
+            // spend is, to each frame as the output threads finish it.
+            FrameStats output = encoder_get_stats();
             if (!is_sixel_module) {
-                buffer_flush();
+                pipeline_submit(stats_frame_id());
+                stats_skip();
             }
-            last_frame_time = current_time;
+            stats_end_frame(is_sixel_module ? 0 : output.bytes);
+            charge_output();
 
             // Check for next slide
             if (!single_mode && elapsed_slide_seconds >= slide_duration) {
-                current_module_index = (current_module_index + 1) % num_art_modules;
+                next_index = (current_module_index + 1) % num_art_modules;
                 break;
             }
 
-            // Use nanosleep instead of the obsolete usleep
-            struct timespec sleep_time;
-            long long sleep_ns = (1000000000LL / target_fps);
-            sleep_time.tv_sec = sleep_ns / 1000000000LL;
-            sleep_time.tv_nsec = sleep_ns % 1000000000LL;
-            nanosleep(&sleep_time, NULL);
+            // Wake up again at the next frame deadline, whatever this frame
+            // took. Frames drawn for input between ticks keep the schedule.
+            if (is_static_sixel && drawn) {
+                arm_timer(frame_timer, (struct timespec){0, 0}, 0);
+                continue;
+            }
+            if (frame_tick || idle) {
+                if (idle) pacing_reset(); // Back on the schedule from now
+                pacing_advance();
+            }
+            struct timespec wake = pacing_deadline();
+            idle = 0;
+
+            // Sleep through frames that would look the same (not while the
+            // HUD is up, its numbers change every frame). A frame the output
+            // dropped only gets to the screen with the next one, so stay on
+            // the schedule until one is through.
+            if (current_module->next_change && !show_info_hud && !has_outgoing) {
+                double change = art_instance_next_change(&instance, elapsed_slide_seconds);
+                if (!single_mode && change > slide_duration) change = slide_duration;
+                struct timespec change_time = timespec_after(slide_start_time, isinf(change) ? 0 : change);
+                int later = isinf(change) || change_time.tv_sec > wake.tv_sec ||
+                            (change_time.tv_sec == wake.tv_sec && change_time.tv_nsec > wake.tv_nsec);
+                int dropped = later && !is_sixel_module && pipeline_frame_dropped();
+                if (later && !dropped) {
+                    idle = 1;
+                    if (isinf(change)) {
+                        arm_timer(frame_timer, (struct timespec){0, 0}, 0);
+                        continue;
+                    }
+                    wake = change_time;
+                }
+            }
+            arm_timer(frame_timer, wake, 1);
         }
 
-        if (current_module->destroy) {
-            current_module->destroy();
+        // Keep the slide running for the transition into the next one.
+        // Sixel slides draw straight to the terminal and cannot be mixed.
+        if (has_outgoing) {
+            art_instance_destroy(&outgoing);
+            has_outgoing = 0;
         }
+        if (transition_kind != TRANSITION_NONE && transition_seconds > 0 && !is_sixel_module &&
+            !module_is_sixel(&art_modules[next_index])) {
+            outgoing = instance;
+            outgoing_time = instance.frame.time;
+            has_outgoing = 1;
+        } else {
+            art_instance_destroy(&instance);
+        }
+        current_module_index = next_index;
     }
 
 cleanup:
+    warmup_cancel();
+    close(epoll_fd);
+    close(frame_timer);
+    close(resize_timer);
+    pipeline_stop();
+    charge_output();
+    buffer_free(&from_frame);
+    buffer_free(&to_frame);
     destroy_buffer();
     cleanup_terminal();
+    threadpool_destroy();
+    // A cancelled download may still be running; the process is about to
+    // go anyway
+    if (!warmup_busy()) curl_global_cleanup();
+    stats_print_summary(stdout);
+    printf("Missed frame deadlines: %d\n", pacing_missed());
+    return 0;
+}
+
+// Render a module off-screen as fast as possible and report the throughput.
+// Frames are encoded as usual but never written; time is simulated at the
+// target fps so every run draws the same frames.
+int run_headless(int module_index, int width, int height, int frames) {
+    ArtModuleV2 *module = &art_modules[module_index];
+    if (module_is_sixel(module)) {
+        fprintf(stderr, "Module '%s' draws with Sixel and cannot run headless.\n", module->name);
+        return 1;
+    }
+    if (!init_buffer(width, height)) {
+        fprintf(stderr, "Failed to initialize screen buffer.\n");
+        return 1;
+    }
+    encoder_set_discard(1);
+    srand(1);
+
+    ArtInstance instance;
+    if (!art_instance_create(&instance, module, width, height, get_current_palette())) {
+        destroy_buffer();
+        fprintf(stderr, "Module '%s' failed to start.\n", module->name);
+        return 1;
+    }
+
+    size_t total_bytes = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int frame = 0; frame < frames; frame++) {
+        double time = (double)frame / target_fps;
+        stats_begin_frame(module->name);
+        art_instance_update(&instance, time / slide_duration, time);
+        stats_mark(PHASE_UPDATE);
+        buffer_clear();
+        art_instance_draw(&instance, get_buffer(), get_current_palette());
+        stats_mark(PHASE_DRAW);
+        buffer_flush();
+        stats_mark(PHASE_ENCODE);
+        stats_end_frame(encoder_get_stats().bytes);
+        total_bytes += encoder_get_stats().bytes;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    art_instance_destroy(&instance);
+    destroy_buffer();
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s %dx%d: %d frames in %.3fs (%.1f fps), %.1f bytes/frame\n",
+           module->name, width, height, frames, seconds,
+           seconds > 0 ? frames / seconds : 0.0,
+           frames > 0 ? (double)total_bytes / frames : 0.0);
+    stats_print_summary(stdout);
     return 0;
 }
 
-void populate_modules() {
+// Charge the output threads' time to the frames they have finished since
+// the last call
+void charge_output() {
+    FrameOutput output;
+    while (encoder_take_output(&output)) {
+        stats_add_output(output.frame, PHASE_ENCODE, output.encode_seconds);
+        stats_add_output(output.frame, PHASE_WRITE, output.write_seconds);
+    }
+}
+
+// Arm a timerfd to fire once, at an absolute CLOCK_MONOTONIC time or after a
+// delay; a zero relative delay disarms it
+void arm_timer(int fd, struct timespec when, int absolute) {
+    struct itimerspec spec = {.it_interval = {0, 0}, .it_value = when};
+    timerfd_settime(fd, absolute ? TFD_TIMER_ABSTIME : 0, &spec, NULL);
+}
+
+struct timespec timespec_after(struct timespec base, double seconds) {
+    long long ns = base.tv_nsec + (long long)(seconds * 1e9);
+    base.tv_sec += ns / 1000000000LL;
+    base.tv_nsec = ns % 1000000000LL;
+    return base;
+}
+
+void apply_resize(ArtInstance *instance) {
+    int width = term_get_width();
+    int height = term_get_height();
+    pipeline_drain(); // The output threads must not be using the buffers
+    if (!resize_buffer(width, height)) return;
+
+    art_instance_resize(instance, width, height, get_current_palette());
+}
+
+void populate_modules(int probe_sixel) {
     art_modules[0] = get_mandelbrot_module();
     art_modules[1] = get_plasma_module();
     art_modules[2] = get_starfield_module();
@@ -237,9 +629,11 @@ void populate_modules() {
     art_modules[4] = get_gameoflife_module();
     art_modules[5] = get_cube_module();
     art_modules[6] = get_clock_module();
-    art_modules[7] = get_image_module();
-    if (is_sixel_supported()) {
-        art_modules[8] = get_mtg_sixel_module();
+    image_module = get_image_module();
+    art_modules[7] = art_module_wrap(&image_module);
+    if (probe_sixel && is_sixel_supported()) {
+        mtg_sixel_module = get_mtg_sixel_module();
+        art_modules[8] = art_module_wrap(&mtg_sixel_module);
     } else {
         art_modules[8] = get_mtg_module();
     }
@@ -253,6 +647,16 @@ void print_usage(const char *prog_name) {
     printf("  -l, --list               List available art modules and exit\n");
     printf("  -s, --start-with <name>  Start with a specific module\n");
     printf("  -r, --random             Randomize the order of modules\n");
+    printf("  -c, --colors <profile>   Color output: truecolor, 256 or 16 (default: detect)\n");
+    printf("  -D, --dither             Dither colors in the 256/16 color profiles\n");
+    printf("  -t, --threads <num>      Threads for drawing (default: one per CPU)\n");
+    printf("      --pacing <policy>    Late frames: skip or catch-up (default: skip)\n");
+    printf("      --transition <kind>  Between slides: none, fade, wipe or dissolve (default: none)\n");
+    printf("      --transition-time <secs>  How long a transition takes (default: 1)\n");
+    printf("      --headless           Benchmark one module without a terminal\n");
+    printf("      --module <name>      Module to benchmark (same as --start-with)\n");
+    printf("      --size <WxH>         Screen size for --headless (default: 80x24)\n");
+    printf("      --frames <num>       Frames to render with --headless (default: 500)\n");
     printf("  -h, --help               Show this help message\n");
 }
 
@@ -266,29 +670,49 @@ void list_modules() {
 void shuffle_modules() {
     for (int i = num_art_modules - 1; i > 0; i--) {
         int j = rand() % (i + 1);
-        ArtModule temp = art_modules[i];
+        ArtModuleV2 temp = art_modules[i];
         art_modules[i] = art_modules[j];
         art_modules[j] = temp;
     }
 }
 
-void draw_hud(double time_left, int current_module_index, double fps) {
+void draw_hud(double time_left, int current_module_index) {
     char hud_text[256];
+    FrameStats stats = encoder_get_stats();
     snprintf(hud_text, sizeof(hud_text),
-        "| %s | Time: %.1fs | FPS: %.1f | [P]ause [N]ext [B]ack [I]nfo [Q]uit |",
+        "| %s | Time: %.1fs | FPS: %.1f/%d Miss: %d | Out: %.1fKB/%dw Drop: %d | [P]ause [N]ext [B]ack [I]nfo [Q]uit |",
         art_modules[current_module_index].name,
         time_left < 0 ? 0 : time_left,
-        fps);
+        stats_fps(),
+        target_fps,
+        pacing_missed(),
+        stats.bytes / 1024.0,
+        stats.syscalls,
+        stats.dropped);
     buffer_draw_text(1, 1, hud_text, (Color){255, 255, 255}, (Color){50, 50, 50});
+
+    // Where the time goes, averaged over the last frames
+    snprintf(hud_text, sizeof(hud_text),
+        "| us: in %.0f upd %.0f draw %.0f enc %.0f write %.0f | %.1fKB/frame | ms p50 %.1f p95 %.1f p99 %.1f |",
+        stats_phase_us(PHASE_INPUT),
+        stats_phase_us(PHASE_UPDATE),
+        stats_phase_us(PHASE_DRAW),
+        stats_phase_us(PHASE_ENCODE),
+        stats_phase_us(PHASE_WRITE),
+        stats_bytes_per_frame() / 1024.0,
+        stats_frame_ms(50),
+        stats_frame_ms(95),
+        stats_frame_ms(99));
+    buffer_draw_text(1, 2, hud_text, (Color){255, 255, 255}, (Color){50, 50, 50});
 }
 
-int handle_input(int current_index) {
-    int c = term_get_key();
-    if (c != -1) {
-        if (art_modules[current_index].handle_input) {
-            art_modules[current_index].handle_input(c);
-        }
-    }
+// Sixel modules draw straight to the terminal instead of into the buffer
+int module_is_sixel(const ArtModuleV2 *module) {
+    return strcmp(module->name, "image") == 0 || strcmp(module->name, "mtg-sixel") == 0;
+}
+
+int handle_input(int c, int current_index, ArtInstance *instance) {
+    art_instance_handle_input(instance, c);
     switch (c) {
         case 'q': return -2; // Quit signal
         case 'p': is_paused = !is_paused; break;
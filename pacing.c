@@ -0,0 +1,67 @@
+// Define the POSIX source to get clock_gettime declarations
+#define _POSIX_C_SOURCE 200809L
+
+#include "pacing.h"
+#include <string.h>
+
+// Catching up never runs more than this many frames behind; past that the
+// schedule restarts instead of rendering a burst
+#define MAX_CATCH_UP_FRAMES 5
+
+static long long period_ns = 1000000000LL / 25;
+static PacingPolicy policy = PACING_SKIP;
+static long long deadline_ns; // When the next frame is due
+static int missed;
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void pacing_start(int fps, PacingPolicy new_policy) {
+    period_ns = 1000000000LL / (fps > 0 ? fps : 1);
+    policy = new_policy;
+    pacing_reset();
+}
+
+void pacing_reset() {
+    deadline_ns = now_ns();
+}
+
+void pacing_advance() {
+    long long now = now_ns();
+    deadline_ns += period_ns;
+    if (now <= deadline_ns) return;
+
+    // Late: this many deadlines have gone by, including the next frame's
+    long long behind = (now - deadline_ns) / period_ns + 1;
+    if (policy == PACING_CATCH_UP && behind <= MAX_CATCH_UP_FRAMES) {
+        // Start the next frame right away and keep the original schedule;
+        // each frame that still ends late counts as its own miss
+        missed++;
+    } else {
+        // Stay on the frame grid, but give up the slots already missed
+        missed += behind;
+        deadline_ns += behind * period_ns;
+    }
+}
+
+struct timespec pacing_deadline() {
+    return (struct timespec){deadline_ns / 1000000000LL, deadline_ns % 1000000000LL};
+}
+
+int pacing_missed() {
+    return missed;
+}
+
+int pacing_parse_policy(const char *name, PacingPolicy *out) {
+    if (strcmp(name, "skip") == 0) {
+        *out = PACING_SKIP;
+    } else if (strcmp(name, "catch-up") == 0) {
+        *out = PACING_CATCH_UP;
+    } else {
+        return 0;
+    }
+    return 1;
+}
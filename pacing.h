@@ -0,0 +1,32 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <time.h>
+
+// What to do when a frame finishes after its deadline
+typedef enum {
+    PACING_SKIP,      // Drop the missed slots and wait for the next one on the schedule
+    PACING_CATCH_UP,  // Render the missed frames back to back until back on schedule
+} PacingPolicy;
+
+// Set the frame rate and late-frame policy; the schedule starts now
+void pacing_start(int fps, PacingPolicy policy);
+
+// Restart the schedule with a frame due now (after a slide change or any
+// other pause)
+void pacing_reset();
+
+// Schedule the next frame after one has been rendered. Deadlines are
+// absolute, so render time does not add to the frame period.
+void pacing_advance();
+
+// When the next frame is due, as a CLOCK_MONOTONIC time
+struct timespec pacing_deadline();
+
+// How many frame deadlines have been missed so far
+int pacing_missed();
+
+// Parse "skip" or "catch-up"; returns 0 for anything else
+int pacing_parse_policy(const char *name, PacingPolicy *out);
+
+#endif // PACING_H
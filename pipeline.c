@@ -0,0 +1,125 @@
+// Define the POSIX source to get sem_t declarations
+#define _POSIX_C_SOURCE 200809L
+
+#include "pipeline.h"
+#include "encoder.h"
+#include "terminal.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// More slots than frames, so a push never finds the ring full
+#define RING_SIZE 4
+
+// Single-producer/single-consumer ring of frames. The semaphore counts the
+// frames in it and lets the consumer sleep while it is empty.
+typedef struct {
+    ScreenBuffer *slots[RING_SIZE];
+    long ids[RING_SIZE];  // The stats id of each frame, for its output time
+    atomic_uint head; // Next slot to pop, only moved by the consumer
+    atomic_uint tail; // Next slot to push, only moved by the producer
+    sem_t count;
+} FrameRing;
+
+// Drawn frames going to the encoder, and frames it is done with coming back
+static FrameRing ready_ring;
+static FrameRing free_ring;
+
+static pthread_t encode_thread;
+static int running;
+// A free frame pipeline_drain() took back from the encoder
+static ScreenBuffer *drained;
+
+static void ring_init(FrameRing *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    sem_init(&ring->count, 0, 0);
+}
+
+static void ring_push(FrameRing *ring, ScreenBuffer *frame, long id) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ring->slots[tail % RING_SIZE] = frame;
+    ring->ids[tail % RING_SIZE] = id;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    sem_post(&ring->count);
+}
+
+static ScreenBuffer *ring_pop(FrameRing *ring, long *id) {
+    while (sem_wait(&ring->count) != 0) {} // Retry on EINTR
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    // Pairs with the release in ring_push: the slot and the frame are written
+    (void)atomic_load_explicit(&ring->tail, memory_order_acquire);
+    ScreenBuffer *frame = ring->slots[head % RING_SIZE];
+    if (id) *id = ring->ids[head % RING_SIZE];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return frame;
+}
+
+static void *encode_main(void *arg) {
+    (void)arg;
+    ScreenBuffer *frame;
+    long id;
+    // A NULL frame asks the thread to stop
+    while ((frame = ring_pop(&ready_ring, &id)) != NULL) {
+        encoder_set_frame_id(id);
+        ring_push(&free_ring, buffer_encode(frame), 0);
+    }
+    return NULL;
+}
+
+int pipeline_start() {
+    if (running) return 1;
+    ring_init(&ready_ring);
+    ring_init(&free_ring);
+    if (!encoder_start_writer()) return 0;
+    if (term_start_thread(&encode_thread, encode_main, NULL) != 0) {
+        encoder_stop_writer();
+        return 0;
+    }
+    // The third frame is free to draw into once the current one is submitted
+    ring_push(&free_ring, buffer_spare(), 0);
+    drained = NULL;
+    running = 1;
+    return 1;
+}
+
+void pipeline_stop() {
+    if (!running) return;
+    ring_push(&ready_ring, NULL, 0);
+    pthread_join(encode_thread, NULL);
+    encoder_stop_writer();
+    sem_destroy(&ready_ring.count);
+    sem_destroy(&free_ring.count);
+    running = 0;
+}
+
+void pipeline_submit(long id) {
+    if (!running) {
+        encoder_set_frame_id(id);
+        buffer_flush();
+        return;
+    }
+    ring_push(&ready_ring, get_buffer(), id);
+    if (drained) {
+        buffer_set_target(drained);
+        drained = NULL;
+    } else {
+        buffer_set_target(ring_pop(&free_ring, NULL));
+    }
+}
+
+void pipeline_drain() {
+    if (!running) return;
+    // One frame is always in flight between submits; once it is back from
+    // the encoder, the encoder is idle. Keep it for the next submit.
+    if (!drained) drained = ring_pop(&free_ring, NULL);
+    encoder_wait_written();
+}
+
+int pipeline_frame_dropped() {
+    if (!running) return encoder_last_frame_dropped();
+    // As in pipeline_drain(), but the write may carry on
+    if (!drained) drained = ring_pop(&free_ring, NULL);
+    return encoder_last_frame_dropped();
+}
@@ -0,0 +1,29 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "buffer.h"
+
+// Run encoding and writing on their own threads so the next frame can be
+// updated and drawn while the last one is encoded and the one before it is
+// written. Call after init_buffer().
+int pipeline_start();
+
+// Finish the frames in flight and stop the threads
+void pipeline_stop();
+
+// Hand the drawn frame over to be encoded and switch drawing to a free
+// frame. Waits while the encoder is still busy with the previous frame.
+// The frame's output time is reported under id (see encoder_take_output()).
+void pipeline_submit(long id);
+
+// Wait until the encoder is done with the last submitted frame and return
+// whether it was dropped because the terminal was still busy. Its changes
+// then only show up once another frame is drawn.
+int pipeline_frame_dropped();
+
+// Wait until every submitted frame has been encoded and written. Do this
+// before touching the terminal or the buffers outside the drawing calls
+// (resizes, sixel output).
+void pipeline_drain();
+
+#endif // PIPELINE_H
@@ -0,0 +1,242 @@
+// Define the POSIX source to get clock_gettime declarations
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Frames the HUD averages over
+#define WINDOW_SIZE 128
+#define MAX_MODULES 16
+// Frame time histogram for the exit summary: 8 buckets per power of two
+// microseconds, up to about an hour
+#define HISTOGRAM_STEPS 8
+#define HISTOGRAM_BUCKETS (32 * HISTOGRAM_STEPS)
+
+typedef struct ModuleSummary ModuleSummary;
+
+typedef struct {
+    double phase[PHASE_COUNT]; // Seconds spent in each phase
+    double interval;           // Seconds since the previous frame started (0 if unknown)
+    size_t bytes;
+    long id;
+    ModuleSummary *module;
+} FrameSample;
+
+struct ModuleSummary {
+    const char *name;
+    long frames;
+    double phase_total[PHASE_COUNT];
+    long intervals;
+    double interval_total;
+    size_t bytes_total;
+    unsigned int histogram[HISTOGRAM_BUCKETS];
+};
+
+// Ring of the most recent frames
+static FrameSample window[WINDOW_SIZE];
+static int window_count;
+static int window_next;
+
+static ModuleSummary modules[MAX_MODULES];
+static int module_count;
+
+// The frame being timed
+static FrameSample current;
+static ModuleSummary *current_module;
+static long next_id = 1;
+static int frame_open; // Between stats_begin_frame() and stats_end_frame()
+static double frame_start;
+static double last_mark;
+static double prev_frame_start;
+static const char *prev_module;
+// Time charged before the frame started
+static double carried[PHASE_COUNT];
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ModuleSummary *find_module(const char *name) {
+    for (int i = 0; i < module_count; i++) {
+        if (strcmp(modules[i].name, name) == 0) return &modules[i];
+    }
+    if (module_count == MAX_MODULES) return NULL;
+    modules[module_count].name = name;
+    return &modules[module_count++];
+}
+
+static int histogram_bucket(double us) {
+    if (us < 1) return 0;
+    int exponent;
+    double mantissa = frexp(us, &exponent); // us = mantissa * 2^exponent, mantissa in [0.5, 1)
+    int bucket = (exponent - 1) * HISTOGRAM_STEPS + (int)((mantissa * 2 - 1) * HISTOGRAM_STEPS);
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+// Middle of a bucket, in microseconds
+static double histogram_value(int bucket) {
+    int octave = bucket / HISTOGRAM_STEPS;
+    int step = bucket % HISTOGRAM_STEPS;
+    return ldexp(1.0 + (step + 0.5) / HISTOGRAM_STEPS, octave);
+}
+
+static double histogram_percentile(const ModuleSummary *module, double percentile) {
+    long total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) total += module->histogram[i];
+    if (total == 0) return 0;
+    long rank = (long)ceil(percentile / 100.0 * total);
+    if (rank < 1) rank = 1;
+    long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += module->histogram[i];
+        if (seen >= rank) return histogram_value(i);
+    }
+    return histogram_value(HISTOGRAM_BUCKETS - 1);
+}
+
+void stats_begin_frame(const char *module_name) {
+    double now = now_seconds();
+    memset(&current, 0, sizeof(current));
+    memcpy(current.phase, carried, sizeof(carried));
+    memset(carried, 0, sizeof(carried));
+    // A new slide starts with init(), which is not part of any frame
+    if (prev_module && strcmp(prev_module, module_name) == 0) {
+        current.interval = now - prev_frame_start;
+    }
+    current_module = find_module(module_name);
+    current.id = next_id++;
+    current.module = current_module;
+    frame_open = 1;
+    prev_module = module_name;
+    prev_frame_start = frame_start = last_mark = now;
+}
+
+void stats_mark(FramePhase phase) {
+    double now = now_seconds();
+    current.phase[phase] += now - last_mark;
+    last_mark = now;
+}
+
+void stats_skip() {
+    last_mark = now_seconds();
+}
+
+void stats_add(FramePhase phase, double seconds) {
+    carried[phase] += seconds;
+}
+
+long stats_frame_id() {
+    return current.id;
+}
+
+void stats_add_output(long frame, FramePhase phase, double seconds) {
+    if (frame_open && frame == current.id) {
+        current.phase[phase] += seconds;
+        return;
+    }
+    // Output finishes within a few frames, so look from the newest back
+    for (int i = 1; i <= window_count; i++) {
+        FrameSample *sample = &window[(window_next - i + WINDOW_SIZE) % WINDOW_SIZE];
+        if (sample->id != frame) continue;
+        sample->phase[phase] += seconds;
+        if (sample->module) sample->module->phase_total[phase] += seconds;
+        return;
+    }
+}
+
+void stats_move(FramePhase from, FramePhase to, double seconds) {
+    if (seconds > current.phase[from]) seconds = current.phase[from];
+    current.phase[from] -= seconds;
+    current.phase[to] += seconds;
+}
+
+void stats_end_frame(size_t bytes) {
+    frame_open = 0;
+    current.bytes = bytes;
+    window[window_next] = current;
+    window_next = (window_next + 1) % WINDOW_SIZE;
+    if (window_count < WINDOW_SIZE) window_count++;
+
+    ModuleSummary *module = current_module;
+    if (!module) return;
+    module->frames++;
+    for (int p = 0; p < PHASE_COUNT; p++) module->phase_total[p] += current.phase[p];
+    module->bytes_total += bytes;
+    if (current.interval > 0) {
+        module->intervals++;
+        module->interval_total += current.interval;
+        module->histogram[histogram_bucket(current.interval * 1e6)]++;
+    }
+}
+
+double stats_phase_us(FramePhase phase) {
+    if (window_count == 0) return 0;
+    double total = 0;
+    for (int i = 0; i < window_count; i++) total += window[i].phase[phase];
+    return total / window_count * 1e6;
+}
+
+double stats_bytes_per_frame() {
+    if (window_count == 0) return 0;
+    size_t total = 0;
+    for (int i = 0; i < window_count; i++) total += window[i].bytes;
+    return (double)total / window_count;
+}
+
+double stats_fps() {
+    double total = 0;
+    int count = 0;
+    for (int i = 0; i < window_count; i++) {
+        if (window[i].interval > 0) {
+            total += window[i].interval;
+            count++;
+        }
+    }
+    return total > 0 ? count / total : 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double stats_frame_ms(double percentile) {
+    double sorted[WINDOW_SIZE];
+    int count = 0;
+    for (int i = 0; i < window_count; i++) {
+        if (window[i].interval > 0) sorted[count++] = window[i].interval;
+    }
+    if (count == 0) return 0;
+    qsort(sorted, count, sizeof(double), compare_doubles);
+    // Nearest rank
+    int rank = (int)ceil(percentile / 100.0 * count);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1] * 1e3;
+}
+
+void stats_print_summary(FILE *out) {
+    if (module_count == 0) return;
+    fprintf(out, "%-14s %7s %7s %8s %8s %8s %8s %8s %9s %7s %7s %7s\n",
+            "Module", "Frames", "FPS", "Input", "Update", "Draw", "Encode", "Write",
+            "Bytes/fr", "p50", "p95", "p99");
+    fprintf(out, "%-14s %7s %7s %44s %9s %23s\n", "", "", "", "(us per frame)", "", "(frame time, ms)");
+    for (int i = 0; i < module_count; i++) {
+        const ModuleSummary *module = &modules[i];
+        if (module->frames == 0) continue;
+        fprintf(out, "%-14s %7ld %7.1f", module->name, module->frames,
+                module->interval_total > 0 ? module->intervals / module->interval_total : 0.0);
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            fprintf(out, " %8.0f", module->phase_total[p] / module->frames * 1e6);
+        }
+        fprintf(out, " %9.0f %7.2f %7.2f %7.2f\n",
+                (double)module->bytes_total / module->frames,
+                histogram_percentile(module, 50) / 1e3,
+                histogram_percentile(module, 95) / 1e3,
+                histogram_percentile(module, 99) / 1e3);
+    }
+}
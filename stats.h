@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// The parts of a frame that are timed separately
+typedef enum {
+    PHASE_INPUT,   // Reading and handling keys
+    PHASE_UPDATE,  // The module's update()
+    PHASE_DRAW,    // Clearing the buffer, draw() and the HUD
+    PHASE_ENCODE,  // Diffing the buffers and encoding escape sequences
+    PHASE_WRITE,   // write() to the terminal
+    PHASE_COUNT
+} FramePhase;
+
+// Start timing a frame for the given module
+void stats_begin_frame(const char *module_name);
+
+// Charge the time since the previous mark (or the frame start) to a phase
+void stats_mark(FramePhase phase);
+
+// Let the time since the previous mark go uncharged (waiting on another
+// thread whose time is charged with stats_add())
+void stats_skip();
+
+// Charge time measured outside the frame (input handled between frames)
+// to a phase of the next frame
+void stats_add(FramePhase phase, double seconds);
+
+// Id of the frame being timed, for stats_add_output()
+long stats_frame_id();
+
+// Charge time the output threads spent on a frame to that frame, which
+// has usually ended by the time they are done with it. Frames that have
+// since left the rolling window only count toward their module's totals.
+void stats_add_output(long frame, FramePhase phase, double seconds);
+
+// Move time already charged to one phase over to another (the encoder
+// reports how much of a flush was spent in write())
+void stats_move(FramePhase from, FramePhase to, double seconds);
+
+// Finish the frame and record how many bytes it sent
+void stats_end_frame(size_t bytes);
+
+// Averages over the rolling window of recent frames
+double stats_phase_us(FramePhase phase);
+double stats_bytes_per_frame();
+double stats_fps();
+
+// Percentile (0-100) of frame-to-frame times in the rolling window, in ms
+double stats_frame_ms(double percentile);
+
+// Print one line per module with its averages and frame time percentiles
+void stats_print_summary(FILE *out);
+
+#endif // STATS_H
@@ -1,25 +1,53 @@
+// Define the POSIX source to get poll() and clock_gettime declarations
+#define _POSIX_C_SOURCE 200809L
+
 #include "terminal.h"
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <sys/signalfd.h>
 #include <signal.h>
 
 static struct termios orig_termios;
-static volatile sig_atomic_t resized_flag = 1;
+static int resized_flag = 1;
+
+// Signals the main loop waits for instead of handling them asynchronously
+static sigset_t loop_signals;
+static int signal_fd = -1;
+
+// Input read in bulk and not turned into keys yet
+static unsigned char input_buf[256];
+static size_t input_len;
+static size_t input_pos;
+// A lone ESC at the end of the input may be the start of a sequence whose
+// rest is still on its way. It is held back this long before it counts as
+// the Escape key.
+#define ESCAPE_WAIT_MS 50
+static int escape_waiting;
+static struct timespec escape_since;
 
-static void handle_winch(int sig) {
-    (void)sig;
-    resized_flag = 1;
+static void get_loop_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGWINCH);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGTERM);
 }
 
 void setup_terminal() {
     // Save original terminal settings
     tcgetattr(STDIN_FILENO, &orig_termios);
 
-    // Set up signal handler for window resize
-    signal(SIGWINCH, handle_winch);
+    // Deliver window resizes and termination requests through a descriptor
+    // the main loop can wait on
+    get_loop_signals(&loop_signals);
+    sigprocmask(SIG_BLOCK, &loop_signals, NULL);
+    signal_fd = signalfd(-1, &loop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
 
     struct termios raw = orig_termios;
     // Set to non-canonical mode (process input char-by-char)
@@ -42,6 +70,66 @@ void cleanup_terminal() {
     // Show cursor and clear screen
     printf("\e[?25h\e[0m\e[2J\e[H");
     fflush(stdout);
+
+    if (signal_fd >= 0) {
+        close(signal_fd);
+        signal_fd = -1;
+        sigprocmask(SIG_UNBLOCK, &loop_signals, NULL);
+    }
+}
+
+int term_start_thread(pthread_t *thread, void *(*start)(void *), void *arg) {
+    // A new thread starts with the mask of the thread creating it
+    sigset_t signals, saved;
+    get_loop_signals(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, &saved);
+    int status = pthread_create(thread, NULL, start, arg);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return status;
+}
+
+void term_unblock_signals() {
+    sigset_t signals;
+    get_loop_signals(&signals);
+    sigprocmask(SIG_UNBLOCK, &signals, NULL);
+}
+
+int term_supports_sync_update() {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) return 0;
+
+    // Ask for the state of mode 2026 (DECRQM), then for the device attributes.
+    // Every terminal answers DA1, so its reply tells us when to stop waiting;
+    // terminals without synchronized updates just never answer the first one.
+    const char query[] = "\x1b[?2026$p\x1b[c";
+    if (write(STDOUT_FILENO, query, sizeof(query) - 1) != (ssize_t)(sizeof(query) - 1)) return 0;
+
+    char response[128];
+    size_t len = 0;
+    int supported = 0;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed_ms >= 200) break;
+
+        struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+        if (poll(&pfd, 1, 200 - elapsed_ms) <= 0) break;
+        ssize_t n = read(STDIN_FILENO, response + len, sizeof(response) - 1 - len);
+        if (n <= 0) break;
+        len += n;
+        response[len] = '\0';
+
+        // "\x1b[?2026;<Ps>$y": 1 (set) or 2 (reset) means the mode is known
+        char *report = strstr(response, "\x1b[?2026;");
+        if (report && (report[8] == '1' || report[8] == '2') && report[9] == '$') supported = 1;
+        // The DA1 reply ("\x1b[?...c") always comes last
+        char *attributes = strstr(response, "\x1b[?");
+        while (attributes && strstr(attributes + 1, "\x1b[?")) attributes = strstr(attributes + 1, "\x1b[?");
+        if (attributes && strchr(attributes, 'c')) break;
+        if (len == sizeof(response) - 1) break;
+    }
+    return supported;
 }
 
 int term_get_width() {
@@ -64,24 +152,94 @@ int term_has_resized() {
     return 0;
 }
 
+int term_signal_fd() {
+    return signal_fd;
+}
+
+int term_handle_signals() {
+    struct signalfd_siginfo info;
+    int quit = 0;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGWINCH) {
+            resized_flag = 1;
+        } else {
+            quit = 1;
+        }
+    }
+    return quit;
+}
+
+int term_read_input() {
+    // Move a partial escape sequence to the front and append to it
+    if (input_pos > 0) {
+        memmove(input_buf, input_buf + input_pos, input_len - input_pos);
+        input_len -= input_pos;
+        input_pos = 0;
+    }
+    if (input_len == sizeof(input_buf)) input_len = 0; // Not a sequence after all
+
+    ssize_t n = read(STDIN_FILENO, input_buf + input_len, sizeof(input_buf) - input_len);
+    if (n > 0) {
+        input_len += n;
+        return 1;
+    }
+    // Nothing more will come after end of input or an error such as EIO
+    // once the terminal is gone
+    return n < 0 && (errno == EAGAIN || errno == EINTR);
+}
+
+// Milliseconds since the lone ESC at the end of the input arrived
+static long escape_waited_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - escape_since.tv_sec) * 1000 + (now.tv_nsec - escape_since.tv_nsec) / 1000000;
+}
+
+int term_input_timeout() {
+    if (!escape_waiting) return -1;
+    long left = ESCAPE_WAIT_MS - escape_waited_ms();
+    return left > 0 ? (int)left : 0;
+}
+
 int term_get_key() {
-    char c;
-    if (read(STDIN_FILENO, &c, 1) == 1) {
-        if (c == '\x1b') { // Escape sequence
-            char seq[3];
-            if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-            if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-            if (seq[0] == '[') {
-                switch (seq[1]) {
-                    case 'A': return KEY_UP;
-                    case 'B': return KEY_DOWN;
-                    case 'C': return KEY_RIGHT;
-                    case 'D': return KEY_LEFT;
-                }
+    while (input_pos < input_len) {
+        unsigned char c = input_buf[input_pos];
+        if (c != '\x1b') {
+            input_pos++;
+            return c;
+        }
+
+        // A sequence can be split right after its ESC; only once nothing
+        // has followed for a while is it the Escape key
+        if (input_pos + 1 == input_len) {
+            if (!escape_waiting) {
+                escape_waiting = 1;
+                clock_gettime(CLOCK_MONOTONIC, &escape_since);
             }
+            if (escape_waited_ms() < ESCAPE_WAIT_MS) return -1;
+        }
+        escape_waiting = 0;
+
+        // An ESC that is not followed by '[' or 'O' is the Escape key itself
+        if (input_pos + 1 == input_len ||
+            (input_buf[input_pos + 1] != '[' && input_buf[input_pos + 1] != 'O')) {
+            input_pos++;
             return '\x1b';
         }
-        return c;
+
+        // CSI / SS3: parameter and intermediate bytes, then a final byte
+        size_t end = input_pos + 2;
+        while (end < input_len && (input_buf[end] < 0x40 || input_buf[end] > 0x7e)) end++;
+        if (end == input_len) return -1; // The rest is still on its way
+        input_pos = end + 1;
+        switch (input_buf[end]) {
+            case 'A': return KEY_UP;
+            case 'B': return KEY_DOWN;
+            case 'C': return KEY_RIGHT;
+            case 'D': return KEY_LEFT;
+        }
+        // Ignore sequences we have no key for
     }
+    escape_waiting = 0;
     return -1; // No key pressed
 }
\ No newline at end of file
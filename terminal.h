@@ -1,6 +1,8 @@
 #ifndef TERMINAL_H
 #define TERMINAL_H
 
+#include <pthread.h>
+
 // Special key codes for arrow keys
 #define KEY_UP 1000
 #define KEY_DOWN 1001
@@ -13,6 +15,10 @@ void setup_terminal();
 // Restores the terminal to its original state
 void cleanup_terminal();
 
+// Asks the terminal (DECRQM) whether it supports synchronized updates
+// (mode 2026). Call after setup_terminal().
+int term_supports_sync_update();
+
 // Gets the current width (columns) of the terminal
 int term_get_width();
 
@@ -22,7 +28,32 @@ int term_get_height();
 // Checks if the terminal has been resized since the last check
 int term_has_resized();
 
-// Gets a key press without blocking. Returns -1 if no key is pressed.
+// Descriptor that becomes readable when SIGWINCH, SIGINT or SIGTERM arrive
+// (they are blocked and only delivered through it)
+int term_signal_fd();
+
+// Unblocks those signals again. A forked child calls this before exec, as
+// the blocked mask would otherwise carry over into the new program.
+void term_unblock_signals();
+
+// pthread_create() with those signals blocked in the new thread, so they
+// always go to term_signal_fd() and never to a thread that drops them or
+// dies of them. Every thread is started this way, whenever it starts.
+int term_start_thread(pthread_t *thread, void *(*start)(void *), void *arg);
+
+// Reads the pending signals; returns 1 if we were asked to quit. Resizes
+// are reported by term_has_resized().
+int term_handle_signals();
+
+// Reads all available input into the key buffer. Returns 0 at end of input
+// or on a read error, after which stdin is no use to wait on.
+int term_read_input();
+
+// Gets the next key from the buffered input. Returns -1 if there is none.
 int term_get_key();
 
+// How many milliseconds to wait for more input before term_get_key() has a
+// held-back Escape key to report, or -1 if it has none
+int term_input_timeout();
+
 #endif // TERMINAL_H
\ No newline at end of file
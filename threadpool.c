@@ -0,0 +1,134 @@
+// Define the POSIX source to get sysconf(_SC_NPROCESSORS_ONLN)
+#define _POSIX_C_SOURCE 200809L
+
+#include "threadpool.h"
+#include "art.h"
+#include "terminal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+
+static pthread_t *workers;
+static int worker_count;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static unsigned long generation; // Bumped for every parallel_for
+static int busy_workers;         // Workers still on the current job
+static int shutting_down;
+
+// The job being run
+static ParallelFn job_fn;
+static void *job_ctx;
+static int job_count;
+static int job_chunk;
+static atomic_int job_next;
+
+static void run_chunks() {
+    for (;;) {
+        int begin = atomic_fetch_add(&job_next, job_chunk);
+        if (begin >= job_count) break;
+        int end = begin + job_chunk < job_count ? begin + job_chunk : job_count;
+        job_fn(job_ctx, begin, end);
+    }
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (generation == seen && !shutting_down) pthread_cond_wait(&work_ready, &lock);
+        if (shutting_down) break;
+        seen = generation;
+        pthread_mutex_unlock(&lock);
+
+        run_chunks();
+
+        pthread_mutex_lock(&lock);
+        if (--busy_workers == 0) pthread_cond_signal(&work_done);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int threadpool_init(int threads) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    // The thread calling parallel_for does its share, so it needs one fewer
+    worker_count = 0;
+    if (threads == 1) return 1;
+    workers = malloc(sizeof(pthread_t) * (threads - 1));
+    if (!workers) return 0;
+    shutting_down = 0;
+    for (int i = 0; i < threads - 1; i++) {
+        if (term_start_thread(&workers[i], worker_main, NULL) != 0) break;
+        worker_count++;
+    }
+    return 1;
+}
+
+void threadpool_destroy() {
+    pthread_mutex_lock(&lock);
+    shutting_down = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < worker_count; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+}
+
+int threadpool_size() {
+    return worker_count + 1;
+}
+
+typedef struct {
+    ScreenBuffer *buffer;
+    RowFn fn;
+    void *ctx;
+} RowJob;
+
+static void run_rows(void *ctx, int begin, int end) {
+    RowJob *job = ctx;
+    for (int row = begin; row < end; row++) job->fn(job->buffer, row, job->ctx);
+}
+
+void parallel_for_rows(ScreenBuffer *buffer, RowFn fn, void *ctx) {
+    RowJob job = {buffer, fn, ctx};
+    parallel_for(buffer->height, 1, run_rows, &job);
+}
+
+void parallel_for(int count, int chunk, ParallelFn fn, void *ctx) {
+    if (count <= 0) return;
+    if (chunk < 1) chunk = 1;
+    if (worker_count == 0 || count <= chunk) {
+        fn(ctx, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    job_fn = fn;
+    job_ctx = ctx;
+    job_count = count;
+    job_chunk = chunk;
+    atomic_store(&job_next, 0);
+    busy_workers = worker_count;
+    generation++;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&lock);
+
+    run_chunks();
+
+    pthread_mutex_lock(&lock);
+    while (busy_workers > 0) pthread_cond_wait(&work_done, &lock);
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,22 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Work function for parallel_for: handles items [begin, end)
+typedef void (*ParallelFn)(void *ctx, int begin, int end);
+
+// Start the worker pool. threads is the total number of threads that work on
+// a parallel_for, including the caller; 0 means one per online CPU.
+int threadpool_init(int threads);
+
+// Stop and join the workers
+void threadpool_destroy();
+
+// Threads that share a parallel_for (1 when running single-threaded)
+int threadpool_size();
+
+// Split [0, count) into chunks that the calling thread and the workers take
+// one at a time until none are left, so slow chunks do not hold everyone
+// up. Returns once every chunk is done. Must not be nested.
+void parallel_for(int count, int chunk, ParallelFn fn, void *ctx);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,151 @@
+#include "transition.h"
+#include "art.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Weights are fixed point: 0 is all from, WEIGHT_ONE all to
+#define WEIGHT_ONE 256
+// Cells mixed at a time; the scratch rows live on the stack
+#define SPAN 256
+
+typedef struct {
+    TransitionKind kind;
+    int weight;        // Fade: the weight of every cell
+    double front;      // Wipe: the column the soft edge ends at
+    double edge;       // Wipe: width of the soft edge
+    const ScreenBuffer *from;
+    const ScreenBuffer *to;
+} ComposeJob;
+
+int transition_parse(const char *name, TransitionKind *out) {
+    if (strcmp(name, "none") == 0) {
+        *out = TRANSITION_NONE;
+    } else if (strcmp(name, "fade") == 0) {
+        *out = TRANSITION_FADE;
+    } else if (strcmp(name, "wipe") == 0) {
+        *out = TRANSITION_WIPE;
+    } else if (strcmp(name, "dissolve") == 0) {
+        *out = TRANSITION_DISSOLVE;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Where in [0, WEIGHT_ONE) cell (x, y) switches over when dissolving. The
+// same every frame, so a cell flips once.
+static int dissolve_threshold(int x, int y) {
+    uint32_t h = (uint32_t)x * 0x9E3779B1u ^ (uint32_t)y * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h & (WEIGHT_ONE - 1);
+}
+
+// out = a + (b - a) * w per 8-bit channel. Every term stays below 2^16, so
+// the vector path works in unsigned 16-bit lanes, four cells at a time.
+static void lerp_colors(const uint32_t *a, const uint32_t *b, const uint16_t *w, uint32_t *out, int n) {
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(WEIGHT_ONE);
+    for (; x + 4 <= n; x += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + x));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+        // Spread each cell's weight over its four channel lanes
+        __m128i weights = _mm_loadl_epi64((const __m128i *)(w + x));
+        weights = _mm_unpacklo_epi16(weights, weights);
+        __m128i w_lo = _mm_unpacklo_epi32(weights, weights);
+        __m128i w_hi = _mm_unpackhi_epi32(weights, weights);
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), _mm_sub_epi16(one, w_lo)),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), w_lo));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), _mm_sub_epi16(one, w_hi)),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), w_hi));
+        lo = _mm_srli_epi16(lo, 8);
+        hi = _mm_srli_epi16(hi, 8);
+        _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < n; x++) {
+        uint32_t mixed = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+            uint32_t ca = (a[x] >> shift) & 0xff, cb = (b[x] >> shift) & 0xff;
+            mixed |= ((ca * (WEIGHT_ONE - w[x]) + cb * w[x]) >> 8) << shift;
+        }
+        out[x] = mixed;
+    }
+}
+
+// Mix cells [x0, x0 + n) of row y, n <= SPAN
+static void compose_span(const ComposeJob *job, ScreenBuffer *out, int y, int x0, int n) {
+    const ScreenBuffer *from = job->from, *to = job->to;
+    size_t offset = (size_t)y * out->width + x0;
+    uint16_t weights[SPAN];
+    uint32_t from_fg[SPAN], to_fg[SPAN];
+
+    for (int i = 0; i < n; i++) {
+        int x = x0 + i;
+        switch (job->kind) {
+            case TRANSITION_WIPE: {
+                double w = (job->front - x) / job->edge;
+                weights[i] = w <= 0 ? 0 : w >= 1 ? WEIGHT_ONE : (uint16_t)(w * WEIGHT_ONE);
+                break;
+            }
+            case TRANSITION_DISSOLVE:
+                weights[i] = dissolve_threshold(x, y) < job->weight ? WEIGHT_ONE : 0;
+                break;
+            default:
+                weights[i] = job->weight;
+                break;
+        }
+        // A blank cell shows only its background; fade glyphs into that
+        from_fg[i] = from->glyphs[offset + i] == ' ' ? from->bg[offset + i] : from->fg[offset + i];
+        to_fg[i] = to->glyphs[offset + i] == ' ' ? to->bg[offset + i] : to->fg[offset + i];
+
+        // Until a cell is all one frame, show whichever glyph is not blank,
+        // preferring the frame it is closer to
+        char from_glyph = from->glyphs[offset + i], to_glyph = to->glyphs[offset + i];
+        char glyph;
+        if (weights[i] == 0) glyph = from_glyph;
+        else if (weights[i] == WEIGHT_ONE) glyph = to_glyph;
+        else if (weights[i] < WEIGHT_ONE / 2) glyph = from_glyph != ' ' ? from_glyph : to_glyph;
+        else glyph = to_glyph != ' ' ? to_glyph : from_glyph;
+        out->glyphs[offset + i] = glyph;
+    }
+    lerp_colors(from_fg, to_fg, weights, out->fg + offset, n);
+    lerp_colors(from->bg + offset, to->bg + offset, weights, out->bg + offset, n);
+}
+
+static void compose_row(ScreenBuffer *out, int y, void *ctx) {
+    const ComposeJob *job = ctx;
+    // Cells neither frame wrote are blank in both, and so in the mix
+    uint64_t damage = job->from->damage[y] | job->to->damage[y];
+    if (!damage) return;
+    int start = __builtin_ctzll(damage) << out->damage_shift;
+    int end = (64 - __builtin_clzll(damage)) << out->damage_shift;
+    if (end > out->width) end = out->width;
+
+    for (int x = start; x < end; x += SPAN) {
+        compose_span(job, out, y, x, end - x < SPAN ? end - x : SPAN);
+    }
+    out->damage[y] |= damage;
+}
+
+void transition_compose(TransitionKind kind, double t, const ScreenBuffer *from,
+                        const ScreenBuffer *to, ScreenBuffer *out) {
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    ComposeJob job = {
+        .kind = kind,
+        .weight = (int)(t * WEIGHT_ONE),
+        .from = from,
+        .to = to,
+    };
+    // The edge starts off the left side of the screen and ends past the right
+    job.edge = out->width / 8 > 1 ? out->width / 8 : 1;
+    job.front = t * (out->width + job.edge);
+    parallel_for_rows(out, compose_row, &job);
+}
@@ -0,0 +1,22 @@
+#ifndef TRANSITION_H
+#define TRANSITION_H
+
+#include "buffer.h"
+
+// How one slide gives way to the next
+typedef enum {
+    TRANSITION_NONE,     // Hard cut
+    TRANSITION_FADE,     // Cross-fade the colors
+    TRANSITION_WIPE,     // A soft edge sweeps left to right, uncovering the new slide
+    TRANSITION_DISSOLVE, // Cells switch over one by one in a fixed random order
+} TransitionKind;
+
+// Parse "none", "fade", "wipe" or "dissolve"; returns 0 for anything else
+int transition_parse(const char *name, TransitionKind *out);
+
+// Draw the mix of two frames of the same size into out at t (0 = all from,
+// 1 = all to). out must be the same size and freshly cleared.
+void transition_compose(TransitionKind kind, double t, const ScreenBuffer *from,
+                        const ScreenBuffer *to, ScreenBuffer *out);
+
+#endif // TRANSITION_H
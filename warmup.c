@@ -0,0 +1,134 @@
+#include "warmup.h"
+#include "terminal.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// One module being created in the background. The job is freed by
+// whichever side is done with it last: the taker, or the thread itself
+// when the job was abandoned before it finished.
+typedef struct {
+    const ArtModuleV2 *module;
+    int width, height;
+    ColorPalette *palette;
+    ArtInstance instance;
+    int created;    // What art_instance_create() returned
+    int done;       // The thread has finished creating
+    int abandoned;  // Nobody wants the instance any more
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} WarmupJob;
+
+static WarmupJob *pending_job;
+
+// Threads still creating or cleaning up, abandoned ones included
+static int running_threads;
+static pthread_mutex_t running_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void free_job(WarmupJob *job) {
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->finished);
+    free(job);
+}
+
+static void *warmup_main(void *arg) {
+    WarmupJob *job = arg;
+    int created = art_instance_create(&job->instance, job->module, job->width, job->height, job->palette);
+
+    pthread_mutex_lock(&job->lock);
+    job->created = created;
+    job->done = 1;
+    int abandoned = job->abandoned;
+    pthread_cond_signal(&job->finished);
+    pthread_mutex_unlock(&job->lock);
+
+    if (abandoned) {
+        art_instance_destroy(&job->instance);
+        free_job(job);
+    }
+
+    pthread_mutex_lock(&running_lock);
+    running_threads--;
+    pthread_mutex_unlock(&running_lock);
+    return NULL;
+}
+
+// Wait until the job's thread has finished creating
+static void wait_done(WarmupJob *job) {
+    pthread_mutex_lock(&job->lock);
+    while (!job->done) pthread_cond_wait(&job->finished, &job->lock);
+    pthread_mutex_unlock(&job->lock);
+}
+
+void warmup_start(const ArtModuleV2 *module, int width, int height, ColorPalette *palette) {
+    warmup_cancel();
+    // A wrapped version 1 module keeps its state in globals, so an
+    // abandoned one would have to be waited for before the module could be
+    // created again, and its init (mtg-sixel's download) is what stalls
+    if (module->legacy) return;
+
+    WarmupJob *job = calloc(1, sizeof(WarmupJob));
+    if (!job) return;
+    job->module = module;
+    job->width = width;
+    job->height = height;
+    job->palette = palette;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->finished, NULL);
+
+    pthread_t thread;
+    pthread_mutex_lock(&running_lock);
+    running_threads++;
+    pthread_mutex_unlock(&running_lock);
+    if (term_start_thread(&thread, warmup_main, job) != 0) {
+        pthread_mutex_lock(&running_lock);
+        running_threads--;
+        pthread_mutex_unlock(&running_lock);
+        free_job(job);
+        return;
+    }
+    pthread_detach(thread);
+    pending_job = job;
+}
+
+int warmup_take(const ArtModuleV2 *module, ArtInstance *instance) {
+    WarmupJob *job = pending_job;
+    if (!job || job->module != module) {
+        warmup_cancel();
+        return 0;
+    }
+    pending_job = NULL;
+
+    wait_done(job);
+    int created = job->created;
+    if (created) {
+        *instance = job->instance;
+    } else {
+        art_instance_destroy(&job->instance);
+    }
+    free_job(job);
+    return created;
+}
+
+void warmup_cancel() {
+    WarmupJob *job = pending_job;
+    if (!job) return;
+    pending_job = NULL;
+
+    pthread_mutex_lock(&job->lock);
+    int done = job->done;
+    job->abandoned = 1;
+    pthread_mutex_unlock(&job->lock);
+
+    // Otherwise the thread cleans up when it finishes
+    if (done) {
+        art_instance_destroy(&job->instance);
+        free_job(job);
+    }
+}
+
+int warmup_busy() {
+    pthread_mutex_lock(&running_lock);
+    int busy = running_threads > 0;
+    pthread_mutex_unlock(&running_lock);
+    return busy;
+}
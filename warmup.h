@@ -0,0 +1,25 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include "art.h"
+
+// Start creating an instance of module on a background thread, so the
+// next slide is ready (downloads done, state seeded) when it comes up.
+// Anything still being prepared is cancelled first. Wrapped version 1
+// modules are left to be created when their slide comes up.
+void warmup_start(const ArtModuleV2 *module, int width, int height, ColorPalette *palette);
+
+// Take the prepared instance if it is one of module, waiting for it to
+// finish if need be. Returns 0 when there is none (anything else being
+// prepared is cancelled) or its create() failed; *instance is then unset.
+int warmup_take(const ArtModuleV2 *module, ArtInstance *instance);
+
+// Throw away whatever is being prepared. Never waits: an instance still
+// being created is destroyed by its thread once it is done.
+void warmup_cancel();
+
+// Whether a thread is still creating an instance, including one that was
+// cancelled
+int warmup_busy();
+
+#endif // WARMUP_H